@@ -0,0 +1,101 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * malloc.h
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_MALLOC_H_
+#define _LIBPHOENIX_MALLOC_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* mallopt() parameters */
+#define M_TRIM_THRESHOLD -1   /* Bytes of empty heaps kept mapped per arena */
+#define M_MMAP_THRESHOLD -3   /* Allocations of this size and above get a dedicated mapping, fixes the threshold */
+#define M_TRIM_HEAPS     -100 /* Number of empty heaps kept mapped per arena */
+
+
+struct mallinfo2 {
+	size_t arena;    /* Bytes mapped for heaps */
+	size_t ordblks;  /* Number of free chunks */
+	size_t smblks;   /* Number of free small chunks */
+	size_t hblks;    /* Number of dedicated mappings */
+	size_t hblkhd;   /* Bytes in dedicated mappings */
+	size_t usmblks;  /* Peak bytes in use (sum of per-arena peaks) */
+	size_t fsmblks;  /* Bytes in free small chunks */
+	size_t uordblks; /* Bytes in use */
+	size_t fordblks; /* Bytes in free chunks */
+	size_t keepcost; /* Bytes in empty heaps kept for reuse */
+};
+
+
+typedef struct {
+	void *ptr;    /* Sampled block */
+	size_t size;  /* Requested size */
+	void *caller; /* Return address of the allocating call */
+	int tid;      /* Allocating thread */
+	int live;     /* Block was not freed yet */
+} malloc_sample_t;
+
+
+/* Allocates size bytes aligned to alignment, which must be a power of two. */
+extern void *memalign(size_t alignment, size_t size);
+
+
+/* Deallocates n blocks (NULL entries are skipped), taking the allocator lock once for consecutive blocks. */
+extern void free_batch(void **ptrs, size_t n);
+
+
+/* Releases empty heaps kept for reuse, leaving at most pad bytes retained per arena. Returns 1 if any memory was released. */
+extern int malloc_trim(size_t pad);
+
+
+/* Adjusts allocator parameter param (M_*) to value. Returns 1 on success, 0 on error. */
+extern int mallopt(int param, int value);
+
+
+/* Returns allocator statistics summed over all arenas. */
+extern struct mallinfo2 mallinfo2(void);
+
+
+/* Prints per-arena allocator statistics to stderr. */
+extern void malloc_stats(void);
+
+
+/* Writes allocator state as XML to stream, options must be 0. */
+extern int malloc_info(int options, FILE *stream);
+
+
+/* Records roughly one allocation per rate allocated bytes, 0 stops sampling. Returns 0 on success, -1 on error. */
+extern int malloc_profile(size_t rate);
+
+
+/* Copies up to n most recent samples (oldest first) to buf. Returns number of samples copied. */
+extern size_t malloc_profileRead(malloc_sample_t *buf, size_t n);
+
+
+/* Writes recorded samples as text to stream. */
+extern int malloc_profileDump(FILE *stream);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* _LIBPHOENIX_MALLOC_H_ */
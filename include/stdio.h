@@ -43,6 +43,7 @@ extern "C" {
 #define _IOFBF 0x2000
 #define _IOLBF 0x4000
 #define _IONBF 0x8000
+#define _IOASYNC 0x10000 /* Full buffering, I/O overlapped by a helper thread */
 
 #define FOPEN_MAX 16
 #define L_ctermid 11 /* Fit at least /dev/pts/XX */
@@ -64,6 +65,7 @@ typedef struct _FILE {
 	size_t bufsz;
 	char *buffer;
 	handle_t lock;
+	struct _FILE_async *async;
 
 	struct _FILE *next;
 	struct _FILE *prev;
@@ -78,12 +80,18 @@ typedef struct _DIR {
 } DIR;
 
 
+typedef ssize_t cookie_read_function_t(void *cookie, char *buf, size_t size);
+typedef ssize_t cookie_write_function_t(void *cookie, const char *buf, size_t size);
+typedef int cookie_seek_function_t(void *cookie, off_t *offset, int whence);
+typedef int cookie_close_function_t(void *cookie);
+
+
 typedef struct _IO_cookie_io_functions
 {
-	void *read;
-	void *write;
-	void *seek;
-	void *close;
+	cookie_read_function_t *read;
+	cookie_write_function_t *write;
+	cookie_seek_function_t *seek;
+	cookie_close_function_t *close;
 } cookie_io_functions_t;
 
 
@@ -131,6 +139,18 @@ FILE *fopen(const char *filename, const char *mode);
 FILE *fdopen(int fd, const char *mode);
 
 
+/* Opens a stream reading from and writing to the memory buffer buf of size bytes, allocated if buf is NULL. */
+FILE *fmemopen(void *buf, size_t size, const char *mode);
+
+
+/* Opens a stream writing to a dynamically growing buffer, *bufp and *sizep are updated on fflush and fclose. */
+FILE *open_memstream(char **bufp, size_t *sizep);
+
+
+/* Opens a stream, which uses functions from io for input and output, cookie is passed to them. */
+FILE *fopencookie(void *cookie, const char *mode, cookie_io_functions_t io);
+
+
 /* Reads data from the given stream into the array pointed to by ptr. */
 size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
 size_t fread_unlocked(void *ptr, size_t size, size_t nmemb, FILE *stream);
@@ -98,6 +98,11 @@ extern long long int strtoll(const char *nptr, char **endptr, int base);
 extern unsigned long long int strtoull(const char *nptr, char **endptr, int base);
 
 
+/* Stores the shortest decimal representation of value which reads back to the same double, notation
+ * is chosen as by %.17g. buf has to hold 25 bytes, returns length of the NUL-terminated string */
+extern size_t dtoa_shortest(double value, char *buf);
+
+
 /* Allocates the requested memory and returns a pointer to it. */
 extern void *calloc(size_t nitems, size_t size);
 
@@ -110,6 +115,14 @@ extern void free(void *ptr);
 extern void *malloc(size_t size);
 
 
+/* Deallocates memory allocated with malloc, calloc or realloc with the requested size. */
+extern void free_sized(void *ptr, size_t size);
+
+
+/* Deallocates memory allocated with aligned_alloc with the requested alignment and size. */
+extern void free_aligned_sized(void *ptr, size_t alignment, size_t size);
+
+
 /* Attempts to resize the memory block pointed to by ptr that was previously allocated with a call to malloc or calloc. */
 extern void *realloc(void *ptr, size_t size);
 
@@ -121,6 +134,14 @@ extern void *realloc(void *ptr, size_t size);
 extern size_t malloc_usable_size(void *ptr);
 
 
+/* Allocates size bytes aligned to alignment, which must be a power of two multiple of sizeof(void *). */
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+
+
+/* Allocates size bytes aligned to alignment, which must be a power of two. */
+extern void *aligned_alloc(size_t alignment, size_t size);
+
+
 /* Causes an abnormal program termination. */
 extern void abort(void) __attribute__((__noreturn__));
 
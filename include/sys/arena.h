@@ -0,0 +1,106 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Region allocator
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_SYS_ARENA_H_
+#define _LIBPHOENIX_SYS_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Objects are allocated by moving a pointer through page-sized blocks taken from malloc().
+ * They are never freed one by one, lib_arenaRewind() frees everything allocated after
+ * a checkpoint and lib_arenaReset() everything at once.
+ */
+
+
+struct _arena_block_t;
+
+
+typedef struct {
+	struct _arena_block_t *block; /* Newest block, NULL while allocating from the initial buffer */
+	char *ptr;                    /* First free byte */
+	char *end;                    /* End of the current block */
+	char *buf;                    /* Initial buffer passed to lib_arenaInit() */
+	size_t bufsz;
+} arena_t;
+
+
+typedef struct {
+	struct _arena_block_t *block;
+	char *ptr;
+	char *end;
+} arena_mark_t;
+
+
+/* Initializes arena, allocations are served from buf (may be NULL, e.g. a stack buffer) before any block is allocated */
+extern void lib_arenaInit(arena_t *arena, void *buf, size_t bufsz);
+
+
+/* Allocates a new block for lib_arenaAlloc() */
+extern void *_lib_arenaGrow(arena_t *arena, size_t size);
+
+
+/* Returns size bytes aligned to 8 bytes or NULL if memory couldn't be allocated */
+static inline void *lib_arenaAlloc(arena_t *arena, size_t size)
+{
+	char *ptr = arena->ptr;
+
+	/* End of the region is aligned, so the rounded size fits as well */
+	if ((size != 0) && (size <= (size_t)(arena->end - ptr))) {
+		arena->ptr = ptr + ((size + 7) & ~(size_t)7);
+		return ptr;
+	}
+
+	return _lib_arenaGrow(arena, size);
+}
+
+
+/* Copies string s to the arena */
+extern char *lib_arenaStrdup(arena_t *arena, const char *s);
+
+
+/* Returns a checkpoint, checkpoints may be nested */
+static inline arena_mark_t lib_arenaMark(arena_t *arena)
+{
+	arena_mark_t mark = { arena->block, arena->ptr, arena->end };
+
+	return mark;
+}
+
+
+/* Frees everything allocated after the checkpoint was taken */
+extern void lib_arenaRewind(arena_t *arena, const arena_mark_t *mark);
+
+
+/* Frees all allocations, one block is kept for reuse */
+extern void lib_arenaReset(arena_t *arena);
+
+
+/* Frees all allocations and blocks */
+extern void lib_arenaDestroy(arena_t *arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Object cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_SYS_SLAB_H_
+#define _LIBPHOENIX_SYS_SLAB_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Objects of a single size are carved from slabs taken from malloc() and kept on a free
+ * list of the cache when freed, slabs are released only by lib_slabDestroy().
+ *
+ * Objects are constructed once, when handed out for the first time. Freed objects have
+ * to be left in the constructed state, the destructor is called by lib_slabDestroy().
+ */
+
+
+/* Frees go to a per-thread magazine, the cache lock is taken once per half a magazine */
+#define SLAB_MAGAZINE 0x1
+
+
+struct _slab_t;
+
+
+typedef struct {
+	handle_t lock;
+	size_t size;                /* Object stride */
+	size_t nslab;               /* Objects per slab */
+	int (*ctor)(void *obj);
+	void (*dtor)(void *obj);
+	struct _slab_t *slabs;
+	void *free;                 /* Constructed free objects */
+	char *fresh;                /* Objects never handed out */
+	char *freshEnd;
+	size_t nused;               /* Objects handed out or kept in magazines */
+	int magazine;               /* Per-thread magazine index, -1 if none */
+} slabcache_t;
+
+
+/* Initializes cache of size bytes objects, ctor returns 0 or a negative errno and may be NULL as well as dtor */
+extern int lib_slabInit(slabcache_t *cache, size_t size, int (*ctor)(void *), void (*dtor)(void *), unsigned int flags);
+
+
+/* Returns an object aligned to 8 bytes or NULL with errno set */
+extern void *lib_slabAlloc(slabcache_t *cache);
+
+
+/* Returns object to the cache */
+extern void lib_slabFree(slabcache_t *cache, void *obj);
+
+
+/* Destructs free objects and releases all slabs, fails with -EBUSY if any object is in use */
+extern int lib_slabDestroy(slabcache_t *cache);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
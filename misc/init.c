@@ -18,6 +18,7 @@ extern void _malloc_init(void);
 extern int _env_init(void);
 extern void _signals_init(void);
 extern void _file_init(void);
+extern void _dir_init(void);
 extern void _errno_init(void);
 extern void _atexit_init(void);
 extern void _init_array(void);
@@ -32,5 +33,6 @@ void _libc_init(void)
 	_env_init();
 	_signals_init();
 	_file_init();
+	_dir_init();
 	_pthread_init();
 }
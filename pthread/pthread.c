@@ -19,6 +19,7 @@
 #include <sys/list.h>
 #include <sys/mman.h>
 #include <sys/minmax.h>
+#include <sys/slab.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdatomic.h>
@@ -83,6 +84,9 @@ static struct {
 		void *stack;
 		size_t stacksize;
 	} to_cleanup;
+	slabcache_t ctx_cache;
+	slabcache_t key_data_cache;
+	slabcache_t cleanup_cache;
 } pthread_common;
 
 
@@ -126,6 +130,15 @@ static const pthread_rwlockattr_t pthread_rwlockattr_default = {
 };
 
 
+extern void _malloc_threadCleanup(void);
+
+
+extern void _slab_threadCleanup(void);
+
+
+extern void sys_endthread(void) __attribute__((noreturn));
+
+
 static __attribute__((noreturn)) void pthread_do_exit(pthread_ctx *ctx, void *value_ptr, int cleanup);
 
 
@@ -149,7 +162,7 @@ static void _pthread_ctx_put(pthread_ctx *ctx)
 	mutexUnlock(pthread_common.pthread_list_lock);
 
 	if (refcnt == 0) {
-		free(ctx);
+		lib_slabFree(&pthread_common.ctx_cache, ctx);
 	}
 }
 
@@ -180,7 +193,7 @@ static void _pthread_do_cleanup(pthread_ctx *ctx)
 		void (*routine)(void *) = head->routine;
 		void *arg = head->arg;
 		ctx->cleanup_list = head->next;
-		free(head);
+		lib_slabFree(&pthread_common.cleanup_cache, head);
 		mutexUnlock(pthread_common.pthread_list_lock);
 		routine(arg);
 		mutexLock(pthread_common.pthread_list_lock);
@@ -212,7 +225,7 @@ static pthread_ctx *pthread_find(handle_t id)
 
 static int pthread_create_main(void)
 {
-	pthread_ctx *ctx = (pthread_ctx *)malloc(sizeof(pthread_ctx));
+	pthread_ctx *ctx = lib_slabAlloc(&pthread_common.ctx_cache);
 	if (ctx == NULL) {
 		return ENOMEM;
 	}
@@ -277,7 +290,7 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
 		}
 	}
 
-	pthread_ctx *ctx = (pthread_ctx *)malloc(sizeof(pthread_ctx));
+	pthread_ctx *ctx = lib_slabAlloc(&pthread_common.ctx_cache);
 
 	if (ctx == NULL) {
 		if (stack != NULL) {
@@ -297,6 +310,7 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
 	ctx->cancelstate = PTHREAD_CANCEL_ENABLE;
 	ctx->cancelled = 0;
 	ctx->cleanup_list = NULL;
+	ctx->exiting = 0;
 	*thread = (pthread_t)ctx;
 
 	mutexLock(pthread_common.pthread_list_lock);
@@ -330,7 +344,7 @@ static void _pthread_release(pthread_ctx *ctx, int self)
 	while (ctx->cleanup_list != NULL) {
 		pthread_cleanup_t *head = ctx->cleanup_list;
 		ctx->cleanup_list = head->next;
-		free(head);
+		lib_slabFree(&pthread_common.cleanup_cache, head);
 	}
 
 	_errno_remove(&ctx->e);
@@ -476,7 +490,7 @@ static void pthread_key_cleanup(pthread_ctx *ctx)
 	while (key_data != NULL) {
 		pthread_key_data_t *curr = key_data;
 		key_data = key_data->next;
-		free(curr);
+		lib_slabFree(&pthread_common.key_data_cache, curr);
 	}
 	ctx->key_data_list = NULL;
 
@@ -569,6 +583,16 @@ static __attribute__((noreturn)) void pthread_do_exit(pthread_ctx *ctx, void *va
 		}
 
 		pthread_key_cleanup(ctx);
+	}
+
+	/*
+	 * Thread caches are flushed while the stack is still ours, once _pthread_release() hands it over it can be
+	 * unmapped by any exiting thread. Closed magazines make its slab frees go straight to the caches.
+	 */
+	_slab_threadCleanup();
+	_malloc_threadCleanup();
+
+	if (ctx != NULL) {
 		if (ctx->is_detached == 0) {
 			ctx->retval = value_ptr;
 		}
@@ -578,7 +602,8 @@ static __attribute__((noreturn)) void pthread_do_exit(pthread_ctx *ctx, void *va
 		}
 	}
 
-	endthread();
+	/* The caches are flushed already and the TLS may be gone, endthread() would flush them again */
+	sys_endthread();
 }
 
 
@@ -1230,7 +1255,7 @@ int pthread_key_delete(pthread_key_t key)
 						else {
 							prev->next = head->next;
 						}
-						free(head);
+						lib_slabFree(&pthread_common.key_data_cache, head);
 					}
 					else {
 						/* Prevent further calls to destructor. */
@@ -1268,7 +1293,7 @@ int pthread_setspecific(pthread_key_t key, const void *value)
 	}
 
 	if (head == NULL) {
-		head = (pthread_key_data_t *)malloc(sizeof(pthread_key_data_t));
+		head = lib_slabAlloc(&pthread_common.key_data_cache);
 		if (head == NULL) {
 			err = ENOMEM;
 		}
@@ -1414,7 +1439,7 @@ void pthread_cleanup_push(void (*routine)(void *), void *arg)
 
 	mutexLock(pthread_common.pthread_list_lock);
 
-	pthread_cleanup_t *head = (pthread_cleanup_t *)malloc(sizeof(pthread_cleanup_t));
+	pthread_cleanup_t *head = lib_slabAlloc(&pthread_common.cleanup_cache);
 	if (head == NULL) {
 		_pthread_ctx_put(ctx);
 		return;
@@ -1452,11 +1477,11 @@ void pthread_cleanup_pop(int execute)
 	if (execute != 0) {
 		void (*routine)(void *) = head->routine;
 		void *arg = head->arg;
-		free(head);
+		lib_slabFree(&pthread_common.cleanup_cache, head);
 		routine(arg);
 	}
 	else {
-		free(head);
+		lib_slabFree(&pthread_common.cleanup_cache, head);
 	}
 }
 
@@ -1841,6 +1866,9 @@ void _pthread_init(void)
 	mutexCreate(&pthread_common.pthread_key_lock);
 	mutexCreate(&pthread_common.pthread_list_lock);
 	mutexCreate(&pthread_common.pthread_atfork_lock);
+	lib_slabInit(&pthread_common.ctx_cache, sizeof(pthread_ctx), NULL, NULL, 0);
+	lib_slabInit(&pthread_common.key_data_cache, sizeof(pthread_key_data_t), NULL, NULL, SLAB_MAGAZINE);
+	lib_slabInit(&pthread_common.cleanup_cache, sizeof(pthread_cleanup_t), NULL, NULL, SLAB_MAGAZINE);
 	pthread_mutex_init(&pthread_common.pthread_once_lock, NULL);
 	pthread_cond_init(&pthread_common.pthread_once_cond, NULL);
 	pthread_common.pthread_list = NULL;
@@ -66,6 +66,7 @@ static char sccsid[] = "@(#)glob.c	8.3 (Berkeley) 10/13/93";
  *	Number of matches in the current invocation of glob.
  */
 
+#include <sys/arena.h>
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -132,6 +133,17 @@ typedef char Char;
 #define	M_SET		META('[')
 #define	ismeta(c)	(((c)&M_QUOTE) != 0)
 
+/*
+ * gl_pathv points into globvec_t, matched paths are allocated from its
+ * arena, so that globfree() releases them at once.
+ */
+typedef struct {
+	arena_t arena;
+	char *pathv[];
+} globvec_t;
+
+#define	GLOBVEC(pathv)	((globvec_t *)((char *)(pathv) - offsetof(globvec_t, pathv)))
+
 
 static int	 compare(const void *p, const void *q);
 static int	 g_Ctoc(const Char *str, char *buf, u_int len);
@@ -667,6 +679,7 @@ glob3(Char *pathbuf, Char *pathend, Char *pathend_last, Char *pattern,
 static int
 globextend(const Char *path, glob_t *pglob, int *limit)
 {
+	globvec_t *vec, *newvec;
 	char **pathv;
 	int i;
 	u_int newsize, len;
@@ -679,16 +692,19 @@ globextend(const Char *path, glob_t *pglob, int *limit)
 	}
 
 	newsize = sizeof(*pathv) * (2 + pglob->gl_pathc + pglob->gl_offs);
-	pathv = pglob->gl_pathv ?
-		    realloc((char *)pglob->gl_pathv, newsize) :
-		    malloc(newsize);
-	if (pathv == NULL) {
-		if (pglob->gl_pathv) {
-			free(pglob->gl_pathv);
+	vec = pglob->gl_pathv ? GLOBVEC(pglob->gl_pathv) : NULL;
+	newvec = realloc(vec, sizeof(*newvec) + newsize);
+	if (newvec == NULL) {
+		if (vec) {
+			lib_arenaDestroy(&vec->arena);
+			free(vec);
 			pglob->gl_pathv = NULL;
 		}
 		return(GLOB_NOSPACE);
 	}
+	if (vec == NULL)
+		lib_arenaInit(&newvec->arena, NULL, 0);
+	pathv = newvec->pathv;
 
 	if (pglob->gl_pathv == NULL && pglob->gl_offs > 0) {
 		/* first time around -- clear initial gl_offs items */
@@ -701,11 +717,9 @@ globextend(const Char *path, glob_t *pglob, int *limit)
 	for (p = path; *p++;)
 		continue;
 	len = (size_t)(p - path);
-	if ((copy = malloc(len)) != NULL) {
-		if (g_Ctoc(path, copy, len)) {
-			free(copy);
+	if ((copy = lib_arenaAlloc(&newvec->arena, len)) != NULL) {
+		if (g_Ctoc(path, copy, len))
 			return (GLOB_NOSPACE);
-		}
 		pathv[pglob->gl_offs + pglob->gl_pathc++] = copy;
 	}
 	pathv[pglob->gl_offs + pglob->gl_pathc] = NULL;
@@ -770,15 +784,12 @@ match(Char *name, Char *pat, Char *patend)
 void
 globfree(glob_t *pglob)
 {
-	int i;
-	char **pp;
+	globvec_t *vec;
 
 	if (pglob->gl_pathv != NULL) {
-		pp = pglob->gl_pathv + pglob->gl_offs;
-		for (i = pglob->gl_pathc; i--; ++pp)
-			if (*pp)
-				free(*pp);
-		free(pglob->gl_pathv);
+		vec = GLOBVEC(pglob->gl_pathv);
+		lib_arenaDestroy(&vec->arena);
+		free(vec);
 		pglob->gl_pathv = NULL;
 	}
 }
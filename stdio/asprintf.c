@@ -15,14 +15,76 @@
 
 #include "stdlib.h"
 #include "stdio.h"
+#include "string.h"
+#include "errno.h"
+#include "limits.h"
+#include "format.h"
+
+
+typedef struct {
+	char *buff;
+	size_t n;
+	size_t size;
+} vasprintf_ctx_t;
+
+
+static int vasprintf_feed(void *context, const char *str, size_t len, char fill)
+{
+	vasprintf_ctx_t *ctx = (vasprintf_ctx_t *)context;
+	size_t size = ctx->size;
+	char *buff;
+
+	if (len > ctx->size - ctx->n) {
+		if (len > (size_t)INT_MAX - ctx->n) {
+			return -EOVERFLOW;
+		}
+		while (len > size - ctx->n) {
+			size *= 2;
+		}
+		if ((buff = realloc(ctx->buff, size)) == NULL) {
+			return -ENOMEM;
+		}
+		ctx->buff = buff;
+		ctx->size = size;
+	}
+
+	if (str != NULL) {
+		memcpy(ctx->buff + ctx->n, str, len);
+	}
+	else {
+		memset(ctx->buff + ctx->n, fill, len);
+	}
+	ctx->n += len;
+
+	return 0;
+}
 
 
 int vasprintf(char **strp, const char *fmt, va_list ap)
 {
-	*strp = malloc(1024); /* FIXME */
-	if (*strp == NULL)
+	vasprintf_ctx_t ctx;
+	int ret;
+
+	ctx.size = 64;
+	ctx.n = 0;
+	if ((ctx.buff = malloc(ctx.size)) == NULL) {
 		return -1;
-	return vsprintf(*strp, fmt, ap);
+	}
+
+	ret = format_parse(&ctx, vasprintf_feed, fmt, ap);
+	if (ret == 0) {
+		ret = vasprintf_feed(&ctx, "", 1, 0);
+	}
+
+	if (ret < 0) {
+		free(ctx.buff);
+		errno = -ret;
+		return -1;
+	}
+
+	*strp = ctx.buff;
+
+	return ctx.n - 1;
 }
 
 
@@ -22,6 +22,9 @@
 #include <sys/mman.h>
 #include <sys/threads.h>
 #include <sys/list.h>
+#include <sys/slab.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include <arch.h>
 #include <stdio.h>
@@ -40,12 +43,50 @@
 #define F_LINE    (1 << 2)
 #define F_ERROR   (1 << 3)
 #define F_USRBUF  (1 << 4)
+#define F_COOKIE  (1 << 5)
+#define F_LAZYBUF (1 << 6) /* Buffer of bufsz bytes is allocated on first I/O */
+#define F_MMAP    (1 << 7) /* Buffer is a read-only mapping of the whole file */
+
+/* Number of BUFSIZ buffers kept for reuse after fclose */
+#define FILE_BUFPOOL 4
 
 typedef struct {
 	FILE file; /* Must be the first member */
 	pid_t pid;
 } popen_FILE;
 
+typedef struct {
+	FILE file; /* Must be the first member */
+	cookie_io_functions_t io;
+	void *cookie;
+} cookie_FILE;
+
+/* Objects of file_common.cache */
+typedef union {
+	popen_FILE p;
+	cookie_FILE c;
+} file_obj_t;
+
+enum { async_idle = 0, async_busy, async_exit };
+
+enum { async_read = 0, async_write };
+
+/* Helper thread of _IOASYNC stream, works on the spare buffer */
+typedef struct _FILE_async {
+	handle_t lock;
+	handle_t cond;
+	pthread_t tid;
+	int state;
+	int op;
+	int pending;   /* Result of the last request is not consumed yet */
+	int readahead; /* Stream is seekable, data read ahead can be given back */
+	char *buf;
+	size_t len;
+	ssize_t ret;
+	int err;
+	file_obj_t io; /* Copy of the stream, its flags change while the helper thread works */
+} file_async_t;
+
 
 static const struct lockAttr flockAttr = {
 	.type = PH_LOCK_RECURSIVE
@@ -58,7 +99,17 @@ FILE *stdin, *stdout, *stderr;
 static struct {
 	FILE *list;
 	handle_t lock;
-} file_common;
+	slabcache_t cache;
+
+	/* Separate lock, buffers are taken with stream locks held */
+	handle_t bufLock;
+	void *bufs[FILE_BUFPOOL];
+	unsigned int nbufs;
+
+	pthread_once_t asyncOnce;
+} file_common = {
+	.asyncOnce = PTHREAD_ONCE_INIT
+};
 
 
 static int string2mode(const char *mode)
@@ -79,8 +130,8 @@ static int string2mode(const char *mode)
 		else if (mode[next_char] == '+') {
 			return O_RDWR;
 		}
-		else if (mode[next_char] == 'c') {
-			/* glibc extension - ignored */
+		else if ((mode[next_char] == 'c') || (mode[next_char] == 'm')) {
+			/* glibc extensions - mapping is handled by fopen */
 			return O_RDONLY;
 		}
 		else {
@@ -149,19 +200,508 @@ static void buffFree(void *ptr, size_t size)
 }
 
 
+static void *file_bufAlloc(size_t size)
+{
+	void *buf = NULL;
+
+	if (size == BUFSIZ) {
+		mutexLock(file_common.bufLock);
+		if (file_common.nbufs != 0) {
+			buf = file_common.bufs[--file_common.nbufs];
+		}
+		mutexUnlock(file_common.bufLock);
+	}
+
+	return (buf != NULL) ? buf : buffAlloc(size);
+}
+
+
+static void file_bufFree(void *buf, size_t size)
+{
+	if (size == BUFSIZ) {
+		mutexLock(file_common.bufLock);
+		if (file_common.nbufs < FILE_BUFPOOL) {
+			file_common.bufs[file_common.nbufs++] = buf;
+			buf = NULL;
+		}
+		mutexUnlock(file_common.bufLock);
+	}
+
+	if (buf != NULL) {
+		buffFree(buf, size);
+	}
+}
+
+
+/* Stream stays unbuffered if the allocation fails */
+static inline void file_lazyBuffer(FILE *stream)
+{
+	if ((stream->flags & F_LAZYBUF) != 0) {
+		stream->flags &= ~F_LAZYBUF;
+		stream->buffer = file_bufAlloc(stream->bufsz);
+	}
+}
+
+
+/* Serves reads of a regular file from its mapping, stream is buffered normally if it can't be mapped */
+static void file_map(FILE *stream)
+{
+#ifndef NOMMU
+	struct stat st;
+	void *addr;
+
+	if ((fstat(stream->fd, &st) < 0) || !S_ISREG(st.st_mode) || (st.st_size == 0) || ((uint64_t)st.st_size > SIZE_MAX)) {
+		return;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, stream->fd, 0);
+	if (addr == MAP_FAILED) {
+		return;
+	}
+
+	stream->buffer = addr;
+	stream->bufsz = st.st_size;
+	stream->bufpos = 0;
+	stream->bufeof = st.st_size;
+	stream->flags = (stream->flags & ~F_LAZYBUF) | F_MMAP;
+#endif
+}
+
+
+/* Stream is left with a lazily allocated buffer */
+static void file_unmap(FILE *stream)
+{
+	munmap(stream->buffer, stream->bufsz);
+	stream->buffer = NULL;
+	stream->bufsz = BUFSIZ;
+	stream->bufpos = stream->bufeof = 0;
+	stream->flags = (stream->flags & ~F_MMAP) | F_LAZYBUF;
+}
+
+
+/* Stream locks are created once per cached object */
+static int file_ctor(void *obj)
+{
+	FILE *file = obj;
+
+	return mutexCreateWithAttr(&file->lock, &flockAttr);
+}
+
+
+static FILE *file_alloc(void)
+{
+	FILE *file;
+	handle_t lock;
+
+	if ((file = lib_slabAlloc(&file_common.cache)) == NULL) {
+		return NULL;
+	}
+
+	lock = file->lock;
+	memset(file, 0, sizeof(file_obj_t));
+	file->lock = lock;
+
+	return file;
+}
+
+
 static void file_free(FILE *file)
 {
 	mutexLock(file_common.lock);
 	LIST_REMOVE(&file_common.list, file);
 	mutexUnlock(file_common.lock);
 
-	if (file->buffer != NULL && !(file->flags & F_USRBUF)) {
-		buffFree(file->buffer, file->bufsz);
+	if ((file->flags & F_MMAP) != 0) {
+		file_unmap(file);
+	}
+	else if (file->buffer != NULL && !(file->flags & F_USRBUF)) {
+		file_bufFree(file->buffer, file->bufsz);
+	}
+
+	lib_slabFree(&file_common.cache, file);
+}
+
+
+/* Stream I/O goes either to the file descriptor or to the cookie functions */
+static ssize_t file_read(FILE *stream, void *buf, size_t size)
+{
+	cookie_FILE *cf = (cookie_FILE *)stream;
+
+	if ((stream->flags & F_COOKIE) == 0) {
+		return __safe_read_nb(stream->fd, buf, size);
+	}
+
+	/* Stream without read function is always at EOF */
+	return (cf->io.read != NULL) ? cf->io.read(cf->cookie, buf, size) : 0;
+}
+
+
+static ssize_t file_write(FILE *stream, const void *buf, size_t size)
+{
+	cookie_FILE *cf = (cookie_FILE *)stream;
+	ssize_t ret;
+
+	if ((stream->flags & F_COOKIE) == 0) {
+		return __safe_write_nb(stream->fd, buf, size);
+	}
+
+	/* Output is discarded without write function */
+	if (cf->io.write == NULL) {
+		return size;
+	}
+
+	/* Writing nothing is an error, otherwise full_write() would never finish */
+	ret = cf->io.write(cf->cookie, buf, size);
+
+	return (ret > 0) ? ret : -1;
+}
+
+
+static ssize_t full_write(FILE *stream, const void *ptr, size_t size)
+{
+	ssize_t err;
+	ssize_t total = 0;
+
+	while (size > 0) {
+		err = file_write(stream, ptr, size);
+		if (err < 0) {
+			return (errno == EAGAIN) ? total : -1;
+		}
+		ptr += err;
+		total += err;
+		size -= err;
+	}
+
+	return total;
+}
+
+
+static off_t file_seek(FILE *stream, off_t offset, int whence)
+{
+	cookie_FILE *cf = (cookie_FILE *)stream;
+
+	if ((stream->flags & F_COOKIE) == 0) {
+		return lseek(stream->fd, offset, whence);
+	}
+
+	if (cf->io.seek == NULL) {
+		errno = ESPIPE;
+		return -1;
+	}
+
+	if (cf->io.seek(cf->cookie, &offset, whence) < 0) {
+		return -1;
+	}
+
+	return offset;
+}
+
+
+static int file_close(FILE *stream)
+{
+	cookie_FILE *cf = (cookie_FILE *)stream;
+
+	if ((stream->flags & F_COOKIE) == 0) {
+		return __safe_close(stream->fd);
+	}
+
+	return (cf->io.close != NULL) ? cf->io.close(cf->cookie) : 0;
+}
+
+
+/* Reads until the buffer is full, EOF or error */
+static ssize_t file_fill(FILE *stream, char *buf, size_t size)
+{
+	ssize_t err;
+	size_t total = 0;
+
+	while (total < size) {
+		err = file_read(stream, buf + total, size - total);
+		if (err < 0) {
+			return (total > 0) ? total : -1;
+		}
+		else if (err == 0) {
+			break;
+		}
+		total += err;
+	}
+
+	return total;
+}
+
+
+/* Runs as a pthread, so that its stack fits the underlying read/write and the allocator is told on exit */
+static void *file_asyncThread(void *arg)
+{
+	file_async_t *async = arg;
+	FILE *stream = (FILE *)&async->io;
+	ssize_t ret;
+
+	mutexLock(async->lock);
+
+	for (;;) {
+		while (async->state == async_idle) {
+			condWait(async->cond, async->lock, 0);
+		}
+
+		if (async->state == async_exit) {
+			break;
+		}
+
+		mutexUnlock(async->lock);
+
+		if (async->op == async_read) {
+			ret = file_fill(stream, async->buf, async->len);
+		}
+		else {
+			ret = full_write(stream, async->buf, async->len);
+		}
+
+		mutexLock(async->lock);
+		async->ret = ret;
+		async->err = errno;
+		async->state = async_idle;
+		condBroadcast(async->cond);
+	}
+
+	mutexUnlock(async->lock);
+
+	return NULL;
+}
+
+
+static void file_asyncStart(file_async_t *async, int op, size_t len)
+{
+	mutexLock(async->lock);
+	async->op = op;
+	async->len = len;
+	async->pending = 1;
+	async->state = async_busy;
+	mutexUnlock(async->lock);
+	condBroadcast(async->cond);
+}
+
+
+static ssize_t file_asyncWait(file_async_t *async)
+{
+	mutexLock(async->lock);
+	while (async->state == async_busy) {
+		condWait(async->cond, async->lock, 0);
+	}
+	mutexUnlock(async->lock);
+
+	return async->ret;
+}
+
+
+/* Completes the pending write, returns the number of bytes read ahead of the stream buffer */
+static ssize_t file_asyncSync(FILE *stream)
+{
+	file_async_t *async = stream->async;
+	ssize_t ret;
+
+	if ((async == NULL) || (async->pending == 0)) {
+		return 0;
 	}
 
-	resourceDestroy(file->lock);
+	ret = file_asyncWait(async);
+	if (async->op == async_read) {
+		return (ret > 0) ? ret : 0;
+	}
 
-	free(file);
+	async->pending = 0;
+	if (ret != async->len) {
+		errno = async->err;
+		stream->flags |= F_ERROR;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Swaps in the block read ahead and starts reading the next one */
+static ssize_t file_asyncRefill(FILE *stream)
+{
+	file_async_t *async = stream->async;
+	char *buf;
+	ssize_t ret;
+
+	if (async->pending == 0) {
+		file_asyncStart(async, async_read, stream->bufsz);
+	}
+
+	ret = file_asyncWait(async);
+	async->pending = 0;
+
+	if (ret < 0) {
+		errno = async->err;
+		stream->flags |= F_ERROR;
+		return -1;
+	}
+	else if (ret == 0) {
+		stream->flags |= F_EOF;
+		return 0;
+	}
+
+	buf = stream->buffer;
+	stream->buffer = async->buf;
+	async->buf = buf;
+	stream->bufpos = 0;
+	stream->bufeof = ret;
+
+	file_asyncStart(async, async_read, stream->bufsz);
+
+	return ret;
+}
+
+
+/* Hands the full stream buffer over to the helper thread */
+static int file_asyncFlush(FILE *stream)
+{
+	file_async_t *async = stream->async;
+	char *buf;
+
+	if (file_asyncSync(stream) < 0) {
+		return -1;
+	}
+
+	buf = stream->buffer;
+	stream->buffer = async->buf;
+	async->buf = buf;
+
+	file_asyncStart(async, async_write, stream->bufpos);
+	stream->bufpos = 0;
+
+	return 0;
+}
+
+
+/* Stream list is kept consistent for the child */
+static void file_asyncForkPrepare(void)
+{
+	mutexLock(file_common.lock);
+}
+
+
+static void file_asyncForkParent(void)
+{
+	mutexUnlock(file_common.lock);
+}
+
+
+/* Helper threads are not copied to the child, their streams are fully buffered there. Request in flight is left to the parent. */
+static void file_asyncForkChild(void)
+{
+	file_async_t *async;
+	FILE *stream;
+
+	if ((stream = file_common.list) != NULL) {
+		do {
+			if ((async = stream->async) != NULL) {
+				stream->async = NULL;
+				resourceDestroy(async->cond);
+				resourceDestroy(async->lock);
+				file_bufFree(async->buf, stream->bufsz);
+				free(async);
+			}
+			stream = stream->next;
+		} while (stream != file_common.list);
+	}
+
+	mutexUnlock(file_common.lock);
+}
+
+
+static void file_asyncOnce(void)
+{
+	pthread_atfork(file_asyncForkPrepare, file_asyncForkParent, file_asyncForkChild);
+}
+
+
+static int file_asyncInit(FILE *stream)
+{
+	file_async_t *async;
+	sigset_t mask, orgMask;
+	pthread_attr_t attr;
+	int err;
+
+	pthread_once(&file_common.asyncOnce, file_asyncOnce);
+
+	if ((async = malloc(sizeof(file_async_t))) == NULL) {
+		return -1;
+	}
+
+	if ((async->buf = file_bufAlloc(stream->bufsz)) == NULL) {
+		free(async);
+		return -1;
+	}
+
+	if ((err = mutexCreate(&async->lock)) < 0) {
+		goto failed;
+	}
+
+	if ((err = condCreate(&async->cond)) < 0) {
+		resourceDestroy(async->lock);
+		goto failed;
+	}
+
+	async->state = async_idle;
+	async->pending = 0;
+	async->readahead = (file_seek(stream, 0, SEEK_CUR) != (off_t)-1);
+	memcpy(&async->io, stream, sizeof(file_obj_t));
+	stream->async = async;
+
+	/* Signals are left to the application threads, priority is the one of the caller */
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &orgMask);
+	err = -pthread_create(&async->tid, &attr, file_asyncThread, async);
+	pthread_sigmask(SIG_SETMASK, &orgMask, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (err < 0) {
+		stream->async = NULL;
+		resourceDestroy(async->cond);
+		resourceDestroy(async->lock);
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	file_bufFree(async->buf, stream->bufsz);
+	free(async);
+	errno = -err;
+	return -1;
+}
+
+
+/* Stream has to be flushed, the helper thread is idle */
+static void file_asyncStop(FILE *stream)
+{
+	file_async_t *async = stream->async;
+
+	if (async == NULL) {
+		return;
+	}
+
+	mutexLock(async->lock);
+	while (async->state == async_busy) {
+		condWait(async->cond, async->lock, 0);
+	}
+	async->state = async_exit;
+	mutexUnlock(async->lock);
+	condBroadcast(async->cond);
+
+	pthread_join(async->tid, NULL);
+
+	file_bufFree(async->buf, stream->bufsz);
+	resourceDestroy(async->cond);
+	resourceDestroy(async->lock);
+	free(async);
+	stream->async = NULL;
 }
 
 
@@ -175,8 +715,9 @@ int fclose(FILE *stream)
 	}
 
 	err = fflush(stream);
+	file_asyncStop(stream);
 
-	if (__safe_close(stream->fd) < 0) {
+	if (file_close(stream) < 0) {
 		err = EOF;
 	}
 	file_free(stream);
@@ -202,34 +743,22 @@ FILE *fopen(const char *filename, const char *mode)
 		return NULL;
 	}
 
-	if ((f = calloc(1, sizeof(FILE))) == NULL) {
-		err = errno;
-		__safe_close(fd);
-		errno = err;
-		return NULL;
-	}
-
-	if ((f->buffer = buffAlloc(BUFSIZ)) == NULL) {
+	if ((f = file_alloc()) == NULL) {
 		err = errno;
-		free(f);
 		__safe_close(fd);
 		errno = err;
 		return NULL;
 	}
 
-	err = mutexCreateWithAttr(&f->lock, &flockAttr);
-	if (err < 0) {
-		buffFree(f->buffer, BUFSIZ);
-		free(f);
-		__safe_close(fd);
-		errno = -err;
-		return NULL;
-	}
-
 	f->bufsz = BUFSIZ;
+	f->flags = F_LAZYBUF;
 	f->fd = fd;
 	f->mode = m;
 
+	if ((m == O_RDONLY) && (strchr(mode, 'm') != NULL)) {
+		file_map(f);
+	}
+
 	mutexLock(file_common.lock);
 	LIST_ADD(&file_common.list, f);
 	mutexUnlock(file_common.lock);
@@ -240,7 +769,7 @@ FILE *fopen(const char *filename, const char *mode)
 
 FILE *fdopen(int fd, const char *mode)
 {
-	int m, fdm, err;
+	int m, fdm;
 	FILE *f;
 
 	if ((m = string2mode(mode)) < 0) {
@@ -259,24 +788,12 @@ FILE *fdopen(int fd, const char *mode)
 		return NULL;
 	}
 
-	if ((f = calloc(1, sizeof(FILE))) == NULL) {
-		return NULL;
-	}
-
-	if ((f->buffer = buffAlloc(BUFSIZ)) == NULL) {
-		free(f);
-		return NULL;
-	}
-
-	err = mutexCreateWithAttr(&f->lock, &flockAttr);
-	if (err < 0) {
-		buffFree(f->buffer, BUFSIZ);
-		free(f);
-		errno = -err;
+	if ((f = file_alloc()) == NULL) {
 		return NULL;
 	}
 
 	f->bufsz = BUFSIZ;
+	f->flags = F_LAZYBUF;
 	f->fd = fd;
 	f->mode = m;
 
@@ -302,8 +819,15 @@ FILE *freopen(const char *pathname, const char *mode, FILE *stream)
 		return NULL;
 	}
 
+	file_asyncStop(stream);
+
 	if (pathname != NULL) {
-		__safe_close(stream->fd);
+		file_close(stream);
+		stream->flags &= ~F_COOKIE;
+
+		if ((stream->flags & F_MMAP) != 0) {
+			file_unmap(stream);
+		}
 
 		if ((stream->fd = __safe_open(pathname, m, DEFFILEMODE)) < 0) {
 			file_free(stream);
@@ -311,6 +835,10 @@ FILE *freopen(const char *pathname, const char *mode, FILE *stream)
 		}
 
 		stream->mode = m;
+
+		if ((m == O_RDONLY) && (strchr(mode, 'm') != NULL) && (stream->buffer == NULL)) {
+			file_map(stream);
+		}
 	}
 	else {
 		/* TODO: change mode */
@@ -320,38 +848,54 @@ FILE *freopen(const char *pathname, const char *mode, FILE *stream)
 }
 
 
-static ssize_t full_write(int fd, const void *ptr, size_t size)
+FILE *fopencookie(void *cookie, const char *mode, cookie_io_functions_t io)
 {
-	ssize_t err;
-	ssize_t total = 0;
+	int m;
+	cookie_FILE *cf;
 
-	while (size > 0) {
-		err = __safe_write_nb(fd, ptr, size);
-		if (err < 0) {
-			return (errno == EAGAIN) ? total : -1;
-		}
-		ptr += err;
-		total += err;
-		size -= err;
+	if ((m = string2mode(mode)) < 0) {
+		errno = EINVAL;
+		return NULL;
 	}
 
-	return total;
+	if ((cf = (cookie_FILE *)file_alloc()) == NULL) {
+		return NULL;
+	}
+
+	cf->file.bufsz = BUFSIZ;
+	cf->file.fd = -1;
+	cf->file.mode = m;
+	cf->file.flags = F_COOKIE | F_LAZYBUF;
+	cf->io = io;
+	cf->cookie = cookie;
+
+	mutexLock(file_common.lock);
+	LIST_ADD(&file_common.list, &cf->file);
+	mutexUnlock(file_common.lock);
+
+	return &cf->file;
 }
 
 
 static int __fflush_one(FILE *stream)
 {
 	int ret = 0;
-	ssize_t err;
+	ssize_t err, ahead;
 	off_t off;
 
-	if (stream->buffer == NULL) {
+	/* Mapping has nothing to flush */
+	if ((stream->buffer == NULL) || ((stream->flags & F_MMAP) != 0)) {
 		return 0;
 	}
 
+	/* Pending write completes first, data read ahead is given back below */
+	if ((ahead = file_asyncSync(stream)) < 0) {
+		return -1;
+	}
+
 	if ((stream->flags & F_WRITING) != 0) {
 		if (stream->bufpos != 0) {
-			err = full_write(stream->fd, stream->buffer, stream->bufpos);
+			err = full_write(stream, stream->buffer, stream->bufpos);
 			if (err != stream->bufpos) {
 				stream->flags |= F_ERROR;
 				ret = -1;
@@ -362,8 +906,8 @@ static int __fflush_one(FILE *stream)
 		}
 	}
 	else {
-		if (stream->bufpos != stream->bufeof) {
-			off = lseek(stream->fd, (off_t)stream->bufpos - stream->bufeof, SEEK_CUR);
+		if ((stream->bufpos != stream->bufeof) || (ahead != 0)) {
+			off = file_seek(stream, (off_t)stream->bufpos - stream->bufeof - ahead, SEEK_CUR);
 			if (off == (off_t)-1) {
 				if (errno == ESPIPE) {
 					/* read buffer for non-seekable stream cannot be flushed */
@@ -375,8 +919,14 @@ static int __fflush_one(FILE *stream)
 			}
 			else {
 				stream->bufpos = stream->bufeof = stream->bufsz;
+				ahead = 0;
 			}
 		}
+
+		/* EOF or error read ahead is dropped as well */
+		if ((stream->async != NULL) && (ahead == 0)) {
+			stream->async->pending = 0;
+		}
 	}
 
 	return ret;
@@ -404,7 +954,7 @@ static inline ssize_t read_buffer(FILE *stream, size_t readsz)
 	 * but stop if at least readsz bytes have already been read.
 	 */
 	while (total < readsz) {
-		err = __safe_read_nb(stream->fd, stream->buffer + total, stream->bufsz - total);
+		err = file_read(stream, stream->buffer + total, stream->bufsz - total);
 		if (err < 0) {
 			stream->flags |= F_ERROR;
 			if (errno != EAGAIN) {
@@ -434,7 +984,7 @@ static inline ssize_t read_data(FILE *stream, void *ptr, size_t readsz)
 	ssize_t total = 0;
 
 	while (readsz > 0) {
-		err = __safe_read_nb(stream->fd, ptr, readsz);
+		err = file_read(stream, ptr, readsz);
 		if (err < 0) {
 			stream->flags |= F_ERROR;
 			if (errno != EAGAIN) {
@@ -466,6 +1016,7 @@ size_t fread_unlocked(void *ptr, size_t size, size_t nmemb, FILE *stream)
 		return 0;
 	}
 
+	file_lazyBuffer(stream);
 	if (stream->buffer == NULL) {
 		/* unbuffered read */
 		err = read_data(stream, ptr, readsz);
@@ -478,6 +1029,15 @@ size_t fread_unlocked(void *ptr, size_t size, size_t nmemb, FILE *stream)
 		return 0;
 	}
 
+	/* Mapping holds the whole file, the end of it is EOF */
+	if ((stream->flags & F_MMAP) != 0) {
+		total = unbuffer_data(stream, ptr, readsz);
+		if (total < readsz) {
+			stream->flags |= F_EOF;
+		}
+		return total / size;
+	}
+
 	/* flush the write buffer if currently writing */
 	if ((stream->flags & F_WRITING) != 0) {
 		if (__fflush_one(stream) < 0) {
@@ -495,6 +1055,17 @@ size_t fread_unlocked(void *ptr, size_t size, size_t nmemb, FILE *stream)
 		total += bytes;
 	}
 
+	/* Descriptor is ahead of the buffer, all data goes through the buffers */
+	if ((stream->async != NULL) && (stream->async->readahead != 0)) {
+		while ((readsz > 0) && (file_asyncRefill(stream) > 0)) {
+			bytes = unbuffer_data(stream, ptr, readsz);
+			ptr += bytes;
+			readsz -= bytes;
+			total += bytes;
+		}
+		return total / size;
+	}
+
 	/* read full blocks directly from the file */
 	if (readsz >= stream->bufsz) {
 		bytes = (readsz / stream->bufsz) * stream->bufsz;
@@ -550,7 +1121,7 @@ static inline size_t buffer_data(FILE *stream, const void *ptr, size_t writesz)
 
 static inline ssize_t write_buffer(FILE *stream, size_t writesz)
 {
-	ssize_t err = full_write(stream->fd, stream->buffer, writesz);
+	ssize_t err = full_write(stream, stream->buffer, writesz);
 	if (err >= 0) {
 		stream->bufpos -= err;
 
@@ -572,7 +1143,7 @@ static inline ssize_t write_buffer(FILE *stream, size_t writesz)
 
 static inline ssize_t write_data(FILE *stream, const void *ptr, size_t writesz)
 {
-	ssize_t err = full_write(stream->fd, ptr, writesz);
+	ssize_t err = full_write(stream, ptr, writesz);
 	if (err >= 0) {
 		if (err < writesz) {
 			/* EAGAIN */
@@ -598,6 +1169,7 @@ size_t fwrite_unlocked(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 		return 0;
 	}
 
+	file_lazyBuffer(stream);
 	if (stream->buffer == NULL) {
 		/* unbuffered write */
 		err = write_data(stream, ptr, writesz);
@@ -623,6 +1195,21 @@ size_t fwrite_unlocked(const void *ptr, size_t size, size_t nmemb, FILE *stream)
 		stream->bufpos = 0;
 	}
 
+	/* Full buffers are written by the helper thread */
+	if (stream->async != NULL) {
+		while (writesz > 0) {
+			bytes = buffer_data(stream, ptr, writesz);
+			ptr += bytes;
+			writesz -= bytes;
+			total += bytes;
+
+			if ((stream->bufpos == stream->bufsz) && (file_asyncFlush(stream) < 0)) {
+				break;
+			}
+		}
+		return total / size;
+	}
+
 	/* fill the incomplete buffer first */
 	if (stream->bufpos > 0 && stream->bufpos < stream->bufsz) {
 		bytes = buffer_data(stream, ptr, writesz);
@@ -857,16 +1444,54 @@ int fflush(FILE *stream)
 }
 
 
+/* Seeks within the mapping, positions past its end are clamped to it so that reads report EOF */
+static off_t file_mapSeek(FILE *stream, off_t offset, int whence)
+{
+	off_t base;
+
+	switch (whence) {
+		case SEEK_SET:
+			base = 0;
+			break;
+
+		case SEEK_CUR:
+			base = stream->bufpos;
+			break;
+
+		case SEEK_END:
+			base = stream->bufeof;
+			break;
+
+		default:
+			errno = EINVAL;
+			return -1;
+	}
+
+	if (offset < -base) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stream->bufpos = (offset > (off_t)stream->bufeof - base) ? stream->bufeof : base + offset;
+
+	return stream->bufpos;
+}
+
+
 static off_t fseek_unlocked(FILE *stream, off_t offset, int whence)
 {
 	int err;
 
+	if ((stream->flags & F_MMAP) != 0) {
+		return file_mapSeek(stream, offset, whence);
+	}
+
 	err = __fflush_one(stream);
 	if (err < 0) {
 		return -1;
 	}
 
-	return lseek(stream->fd, offset, whence);
+	return file_seek(stream, offset, whence);
 }
 
 
@@ -902,9 +1527,18 @@ int fseeko(FILE *stream, off_t offset, int whence)
 
 static off_t ftell_unlocked(FILE *stream)
 {
+	ssize_t ahead;
 	off_t off;
 
-	off = lseek(stream->fd, 0, SEEK_CUR);
+	if ((stream->flags & F_MMAP) != 0) {
+		return stream->bufpos;
+	}
+
+	if ((ahead = file_asyncSync(stream)) < 0) {
+		return -1;
+	}
+
+	off = file_seek(stream, 0, SEEK_CUR);
 	if (off == (off_t)-1) {
 		return -1;
 	}
@@ -915,9 +1549,7 @@ static off_t ftell_unlocked(FILE *stream)
 			off += stream->bufpos;
 		}
 		else {
-			if (stream->bufpos != stream->bufeof) {
-				off -= stream->bufeof - stream->bufpos;
-			}
+			off -= (off_t)(stream->bufeof - stream->bufpos) + ahead;
 		}
 	}
 
@@ -958,12 +1590,17 @@ int fgetpos(FILE *stream, fpos_t *pos)
 
 int fileno(FILE *stream)
 {
-	return stream->fd;
+	return fileno_unlocked(stream);
 }
 
 
 int fileno_unlocked(FILE *stream)
 {
+	if ((stream->flags & F_COOKIE) != 0) {
+		errno = EBADF;
+		return -1;
+	}
+
 	return stream->fd;
 }
 
@@ -1053,6 +1690,7 @@ int putchar(int c)
 
 static int ungetc_unlocked(int c, FILE *stream)
 {
+	file_lazyBuffer(stream);
 	if (c == EOF || stream->buffer == NULL) {
 		return EOF;
 	}
@@ -1066,11 +1704,19 @@ static int ungetc_unlocked(int c, FILE *stream)
 		stream->bufpos = stream->bufeof = stream->bufsz;
 	}
 
-	if (stream->bufpos > 0) {
-		stream->buffer[--stream->bufpos] = c;
+	if (stream->bufpos == 0) {
+		return EOF;
+	}
+
+	/* Mapping is read-only, only the byte which was read can be pushed back */
+	if ((stream->flags & F_MMAP) != 0) {
+		if ((unsigned char)stream->buffer[stream->bufpos - 1] != (unsigned char)c) {
+			return EOF;
+		}
+		stream->bufpos--;
 	}
 	else {
-		return EOF;
+		stream->buffer[--stream->bufpos] = c;
 	}
 
 	stream->flags &= ~F_EOF;
@@ -1192,12 +1838,43 @@ void __fpurge(FILE *stream)
 }
 
 
+/* Makes room for need bytes in *lineptr */
+static int getdelim_reserve(char **lineptr, size_t *n, size_t need)
+{
+	size_t new_n = *n;
+	char *new_lineptr;
+
+	if (need <= *n) {
+		return 0;
+	}
+
+	/* Length of the line has to fit in the return value */
+	if (need > SSIZE_MAX) {
+		return SET_ERRNO(-EOVERFLOW);
+	}
+
+	while (new_n < need) {
+		new_n = (new_n >= SSIZE_MAX / 2) ? SSIZE_MAX : 2 * new_n;
+	}
+
+	new_lineptr = realloc(*lineptr, new_n);
+	if (new_lineptr == NULL) {
+		/* errno set by realloc */
+		return -1;
+	}
+
+	*lineptr = new_lineptr;
+	*n = new_n;
+
+	return 0;
+}
+
+
 ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream)
 {
-	int c;
-	ssize_t ofs;
-	size_t new_n;
-	char *new_lineptr, *endptr, *ptr;
+	int c, ret = 0;
+	size_t len = 0, cnt;
+	char *ptr, *end;
 
 	if (lineptr == NULL || n == NULL || stream == NULL) {
 		errno = EINVAL;
@@ -1213,59 +1890,63 @@ ssize_t getdelim(char **lineptr, size_t *n, int delim, FILE *stream)
 		}
 	}
 
-	ptr = *lineptr;
-	endptr = *lineptr + *n;
+	mutexLock(stream->lock);
 
 	for (;;) {
-		if (ptr + 2 >= endptr) {
-			ofs = ptr - *lineptr;
-
-			/* Need to check for SSIZE_MAX - 1, because setting size
-			 * from SSIZE_MAX - 1 to SSIZE_MAX would be not enough */
-			if ((*n) >= SSIZE_MAX - 1) {
-				return SET_ERRNO(-EOVERFLOW);
-			}
-			else if ((*n) >= SSIZE_MAX / 2) {
-				new_n = SSIZE_MAX;
-			}
-			else {
-				new_n = 2 * (*n);
+		/* Copy whole runs from the read buffer */
+		if ((stream->buffer != NULL) && ((stream->flags & F_WRITING) == 0) && (stream->bufpos != stream->bufeof)) {
+			ptr = stream->buffer + stream->bufpos;
+			cnt = stream->bufeof - stream->bufpos;
+			end = memchr(ptr, delim, cnt);
+			if (end != NULL) {
+				cnt = end - ptr + 1;
 			}
 
-			/* No point in allocating less than 8 via malloc */
-			if (new_n < 8u) {
-				new_n = 8u;
+			if (getdelim_reserve(lineptr, n, len + cnt + 1) < 0) {
+				ret = -1;
+				break;
 			}
 
-			new_lineptr = realloc(*lineptr, new_n);
-			if (new_lineptr == NULL) {
-				/* errno set by realloc */
-				return -1;
-			}
+			memcpy(*lineptr + len, ptr, cnt);
+			stream->bufpos += cnt;
+			len += cnt;
 
-			ptr = new_lineptr + ofs;
-			endptr = new_lineptr + new_n;
+			if (end != NULL) {
+				break;
+			}
 
-			*lineptr = new_lineptr;
-			*n = new_n;
+			continue;
 		}
 
-		c = fgetc(stream);
-		if (c < 0) {
-			if (feof(stream) && ptr != *lineptr) {
-				*ptr = '\0';
-				return ptr - *lineptr;
+		/* Buffer is exhausted (or there is none), refill it */
+		c = fgetc_unlocked(stream);
+		if (c == EOF) {
+			if (!feof_unlocked(stream) || (len == 0)) {
+				ret = -1;
 			}
+			break;
+		}
 
-			return EOF;
+		if (getdelim_reserve(lineptr, n, len + 2) < 0) {
+			ret = -1;
+			break;
 		}
 
-		*ptr++ = c;
-		if (c == delim) {
-			*ptr = '\0';
-			return ptr - *lineptr;
+		(*lineptr)[len++] = c;
+		if (c == (unsigned char)delim) {
+			break;
 		}
 	}
+
+	mutexUnlock(stream->lock);
+
+	if (ret < 0) {
+		return -1;
+	}
+
+	(*lineptr)[len] = '\0';
+
+	return len;
 }
 
 
@@ -1293,35 +1974,45 @@ int feof(FILE *stream)
 
 int setvbuf(FILE *stream, char *buffer, int mode, size_t size)
 {
-
-	char *old_buf;
-	size_t old_siz;
-	int old_flags;
+	/* Buffers are swapped with the helper thread, both are owned by the stream */
+	if ((mode == _IOASYNC) && (buffer != NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
 
 	mutexLock(stream->lock);
 
-	old_buf = stream->buffer;
-	old_flags = stream->flags;
-	old_siz = stream->bufsz;
+	if (__fflush_one(stream) < 0) {
+		mutexUnlock(stream->lock);
+		return -1;
+	}
+
+	file_asyncStop(stream);
+
+	/* Reading continues through the descriptor from the current position */
+	if ((stream->flags & F_MMAP) != 0) {
+		if (lseek(stream->fd, stream->bufpos, SEEK_SET) < 0) {
+			mutexUnlock(stream->lock);
+			return -1;
+		}
+		file_unmap(stream);
+	}
+	else if (stream->buffer != NULL && !(stream->flags & F_USRBUF)) {
+		file_bufFree(stream->buffer, stream->bufsz);
+	}
 
 	stream->buffer = NULL;
-	stream->bufsz = size;
-	stream->flags &= ~(F_USRBUF & F_LINE);
+	stream->bufsz = (size != 0) ? size : BUFSIZ;
+	stream->bufpos = stream->bufeof = 0;
+	stream->flags &= ~(F_USRBUF | F_LINE | F_LAZYBUF);
 
 	if (mode != _IONBF) {
 		if (buffer != NULL) {
 			stream->buffer = buffer;
 			stream->flags |= F_USRBUF;
 		}
-		else if (old_siz != size) {
-			stream->buffer = buffAlloc(size);
-			if (stream->buffer == NULL) {
-				stream->buffer = old_buf;
-				stream->bufsz = old_siz;
-				stream->flags = old_flags;
-				mutexUnlock(stream->lock);
-				return -1;
-			}
+		else {
+			stream->flags |= F_LAZYBUF;
 		}
 
 		if (mode == _IOLBF) {
@@ -1329,8 +2020,10 @@ int setvbuf(FILE *stream, char *buffer, int mode, size_t size)
 		}
 	}
 
-	if (!(old_flags & F_USRBUF) && old_siz != size) {
-		buffFree(old_buf, old_siz);
+	/* Stream stays fully buffered if the helper thread can't be started */
+	if ((mode == _IOASYNC) && (file_asyncInit(stream) < 0)) {
+		mutexUnlock(stream->lock);
+		return -1;
 	}
 
 	mutexUnlock(stream->lock);
@@ -1353,7 +2046,7 @@ FILE *popen(const char *command, const char *mode)
 		return NULL;
 	}
 
-	if ((pf = calloc(1, sizeof(popen_FILE))) == NULL) {
+	if ((pf = (popen_FILE *)file_alloc()) == NULL) {
 		goto failed;
 	}
 
@@ -1361,16 +2054,6 @@ FILE *popen(const char *command, const char *mode)
 		goto failed;
 	}
 
-	if (mutexCreateWithAttr(&pf->file.lock, &flockAttr) < 0) {
-		pf->file.lock = 0;
-		goto failed;
-	}
-
-	pf->file.buffer = mmap(NULL, BUFSIZ, PROT_READ | PROT_WRITE, MAP_ANONYMOUS, -1, 0);
-	if (pf->file.buffer == MAP_FAILED) {
-		goto failed;
-	}
-
 	if ((pid = vfork()) < 0) {
 		goto failed;
 	}
@@ -1392,7 +2075,7 @@ FILE *popen(const char *command, const char *mode)
 	pf->pid = pid;
 	pf->file.bufpos = pf->file.bufeof = 0;
 	pf->file.bufsz = BUFSIZ;
-	pf->file.flags = 0;
+	pf->file.flags = F_LAZYBUF;
 
 	if (mode[0] == 'r') {
 		pf->file.fd = fd[0];
@@ -1411,13 +2094,7 @@ FILE *popen(const char *command, const char *mode)
 
 failed:
 
-	if (pf->file.lock) {
-		resourceDestroy(pf->file.lock);
-	}
-	if (pf->file.buffer != MAP_FAILED) {
-		munmap(pf->file.buffer, BUFSIZ);
-	}
-	free(pf);
+	lib_slabFree(&file_common.cache, pf);
 	close(fd[0]);
 	close(fd[1]);
 	return NULL;
@@ -1446,32 +2123,33 @@ int pclose(FILE *file)
 void _file_init(void)
 {
 	mutexCreate(&file_common.lock);
+	mutexCreate(&file_common.bufLock);
 	file_common.list = NULL;
+	file_common.nbufs = 0;
+
+	/* Popen and cookie streams are allocated from the same cache */
+	lib_slabInit(&file_common.cache, sizeof(file_obj_t), file_ctor, NULL, 0);
 
-	stdin = calloc(1, sizeof(FILE));
-	stdout = calloc(1, sizeof(FILE));
-	stderr = calloc(1, sizeof(FILE));
+	stdin = file_alloc();
+	stdout = file_alloc();
+	stderr = file_alloc();
 
 	stdin->fd = 0;
 	stdout->fd = 1;
 	stderr->fd = 2;
 
-	stdin->buffer = buffAlloc(BUFSIZ);
-	stdout->buffer = buffAlloc(BUFSIZ);
 	stdin->bufsz = BUFSIZ;
 	stdout->bufsz = BUFSIZ;
+	stdin->flags = F_LAZYBUF;
 
 	stdin->bufeof = stdin->bufpos = BUFSIZ;
-	mutexCreateWithAttr(&stdin->lock, &flockAttr);
 
 	stdout->bufpos = 0;
-	stdout->flags = F_WRITING;
-	mutexCreateWithAttr(&stdout->lock, &flockAttr);
+	stdout->flags = F_WRITING | F_LAZYBUF;
 
 	stderr->buffer = NULL;
 	stderr->bufsz = 0;
 	stderr->flags = F_WRITING;
-	mutexCreateWithAttr(&stderr->lock, &flockAttr);
 
 	if (isatty(stdout->fd)) {
 		stdout->flags |= F_LINE;
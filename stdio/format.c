@@ -14,10 +14,11 @@
  */
 
 #include "format.h"
-#include "bignum.h"
+#include "../stdlib/utoa-internal.h"
 
 #include <sys/minmax.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -90,724 +91,452 @@ static const char smallDigits[] = "0123456789abcdef";
 static const char largeDigits[] = "0123456789ABCDEF";
 
 
-static int format_printBuffer(void *ctx, feedfunc feed, uint32_t flags, int minFieldWidth, const char *start, const char *end, char sign)
+/* Outputs padding, sign and optional prefix preceding a conversion, padLen is the space left in the field */
+static int format_printHead(void *ctx, feedfunc feed, uint32_t flags, int padLen, char sign, const char *prefix)
 {
 	int ret = 0;
-	const int digits_cnt = start > end ? start - end : end - start;
-	int pad_len = minFieldWidth - digits_cnt - (sign ? 1 : 0);
+
 	/* If FLAG_ZERO and FLAG_MINUS both appear, then FLAG_ZERO is ignored */
 	if ((flags & FLAG_MINUS) != 0) {
 		flags &= ~FLAG_ZERO;
 	}
 
 	/* pad, if needed */
-	if ((pad_len > 0) && ((flags & FLAG_MINUS) == 0) && ((flags & FLAG_ZERO) == 0)) {
-		while (pad_len-- > 0) {
-			CHECK_FAIL(ret, feed(ctx, ' '));
-		}
+	if ((padLen > 0) && ((flags & FLAG_MINUS) == 0) && ((flags & FLAG_ZERO) == 0)) {
+		CHECK_FAIL(ret, feed(ctx, NULL, padLen, ' '));
 	}
 
 	if (sign != 0) {
-		CHECK_FAIL(ret, feed(ctx, sign));
+		CHECK_FAIL(ret, feed(ctx, &sign, 1, 0));
 	}
 
-	/* pad, if needed */
-	if ((pad_len > 0) && ((flags & FLAG_MINUS) == 0) && ((flags & FLAG_ZERO) != 0)) {
-		while (pad_len-- > 0) {
-			CHECK_FAIL(ret, feed(ctx, '0'));
-		}
-	}
-
-	/* copy */
-	if (start > end) {
-		while ((--start) >= end) {
-			CHECK_FAIL(ret, feed(ctx, *start));
-		}
-	}
-	else {
-		while (start < end) {
-			CHECK_FAIL(ret, feed(ctx, *start++));
-		}
+	if (prefix != NULL) {
+		CHECK_FAIL(ret, feed(ctx, prefix, strlen(prefix), 0));
 	}
 
 	/* pad, if needed */
-	if ((pad_len > 0) && ((flags & FLAG_MINUS) != 0)) {
-		while (pad_len-- > 0) {
-			CHECK_FAIL(ret, feed(ctx, ' '));
-		}
+	if ((padLen > 0) && ((flags & FLAG_MINUS) == 0) && ((flags & FLAG_ZERO) != 0)) {
+		CHECK_FAIL(ret, feed(ctx, NULL, padLen, '0'));
 	}
 
 	return 0;
 }
 
 
-#ifndef IO_NO_FLOAT
-
-#define BIGDOUBLE_DEFAULT_SIZE 4
-
-union double_u64 {
-	double d;
-	uint64_t u;
-};
-
-struct buffer {
-	char *data;
-	size_t len, size;
-};
-
-struct bigdouble {
-	/* Stored number */
-	__bignum_t num;
-	/* Helper values */
-	__bignum_t helper1;
-	uint64_t firstIntegerBit;
-};
-
-
-static inline int format_bufferInit(struct buffer *buff, size_t size)
+/* Outputs padding following a left-justified conversion */
+static int format_printTail(void *ctx, feedfunc feed, uint32_t flags, int padLen)
 {
-	char *data = malloc(size);
-	if (data != NULL) {
-		*buff = (struct buffer) { .data = data, .len = 0, .size = size };
-		return 0;
+	if ((padLen > 0) && ((flags & FLAG_MINUS) != 0)) {
+		return feed(ctx, NULL, padLen, ' ');
 	}
-	else {
-		return -ENOMEM;
-	}
-}
-
 
-static inline int format_bufferAddChar(struct buffer *buff, char c)
-{
-	char *data;
-	if (buff->len >= buff->size) {
-		data = realloc(buff->data, 2 * buff->size);
-		if (data == NULL) {
-			return -ENOMEM;
-		}
-		buff->data = data;
-		buff->size = 2 * buff->size;
-	}
-	buff->data[buff->len++] = c;
 	return 0;
 }
 
 
-static inline void format_bufferDestroy(struct buffer *buff)
-{
-	free(buff->data);
-	buff->data = NULL;
-	buff->size = 0;
-	buff->len = 0;
-}
-
-
-static inline uint64_t format_u64FromDouble(double d)
-{
-	union double_u64 u;
-
-	u.d = d;
-	return u.u;
-}
-
-
-static inline int32_t format_doubleGetExponent(uint64_t num64)
-{
-	return ((int32_t)((num64 >> DOUBLE_EXP_SHIFT) & 0x7ff) - 1023);
-}
-
-
-static int format_bigdoubleInit(struct bigdouble *bd, const size_t size)
+static int format_printBuffer(void *ctx, feedfunc feed, uint32_t flags, int minFieldWidth, const char *start, const char *end, char sign)
 {
-	int res;
+	int ret = 0;
+	const int digits_cnt = end - start;
+	int pad_len = minFieldWidth - digits_cnt - (sign ? 1 : 0);
 
-	CHECK_FAIL(res, __bignum_init(&bd->num, size, 0));
+	CHECK_FAIL(ret, format_printHead(ctx, feed, flags, pad_len, sign, NULL));
 
-	res = __bignum_init(&bd->helper1, size, 0);
-	if (res < 0) {
-		__bignum_destroy(&bd->num);
-		return res;
+	/* copy */
+	if (digits_cnt > 0) {
+		CHECK_FAIL(ret, feed(ctx, start, digits_cnt, 0));
 	}
-	bd->firstIntegerBit = 0;
 
-	return 0;
+	return format_printTail(ctx, feed, flags, pad_len);
 }
 
 
-static void format_bigdoubleDestroy(struct bigdouble *bd)
-{
-	__bignum_destroy(&bd->num);
-	__bignum_destroy(&bd->helper1);
-}
+#ifndef IO_NO_FLOAT
 
+#define DOUBLE_EXP_SHIFT     52
+#define DOUBLE_MANTISSA_MASK ((1LLU << DOUBLE_EXP_SHIFT) - 1)
 
-static int format_bigdoubleIntegerPart(const struct bigdouble *bd, __bignum_t *result)
-{
-	int res = __bignum_copy(result, &bd->num);
+/* Decimal expansion is kept in base 10^9 words */
+#define FP_BASE 1000000000u
 
-	if (res < 0) {
-		return -ENOMEM;
-	}
-	__bignum_shiftr(result, bd->firstIntegerBit);
+/*
+ * Words of the exact expansion of a double: 2 for the 53-bit mantissa and one per
+ * halving by 2^9 down to 2^-1074. The integer part of 2^1024 takes 35 words.
+ */
+#define FP_WORDS (2 + (1074 + 8) / 9 + 1)
 
-	return 0;
-}
+/* Limit of the precision for which digits can still need rounding */
+#define FP_PREC_MAX (9 * FP_WORDS + 400)
 
 
-static void format_bigdoubleCutIntegerPart(struct bigdouble *result)
+static inline uint64_t format_u64FromDouble(double d)
 {
-	const size_t firstIntegerIndex = result->firstIntegerBit / __BIGNUM_DATA_BITS;
-	const size_t fracMask = (1LLU << (result->firstIntegerBit % __BIGNUM_DATA_BITS)) - 1;
-	if (firstIntegerIndex < result->num.len) {
-		result->num.data[firstIntegerIndex] &= fracMask;
-		result->num.len = firstIntegerIndex + 1;
-	}
+	union {
+		double d;
+		uint64_t u;
+	} u;
+
+	u.d = d;
+	return u.u;
 }
 
 
-static int format_bigdoubleLoad(struct bigdouble *result, double val)
+static int format_sprintfHex(void *ctx, feedfunc feed, uint64_t num64, uint32_t flags, int minFieldWidth, int precision, char sign)
 {
-	uint64_t num64 = format_u64FromDouble(val);
-	int32_t exp = format_doubleGetExponent(num64);
-	const int isSubnormalOrZero = exp == -1023;
-	uint64_t mantissa = num64 & DOUBLE_MANTISSA_MASK;
-	int res;
-
-	CHECK_FAIL(res, format_bigdoubleInit(result, BIGDOUBLE_DEFAULT_SIZE));
-
-	__bignum_zero(&result->num);
-	if ((isSubnormalOrZero != 0) && (mantissa == 0)) {
-		/* val == 0 */
-		result->firstIntegerBit = 0;
-		return 0;
-	}
-	/* val != 0 */
-	mantissa |= (isSubnormalOrZero != 0 ? 0LLU : 1LLU) << DOUBLE_EXP_SHIFT;
-	result->num.data[0] = mantissa & __BIGNUM_DATA_MASK;
-	mantissa >>= __BIGNUM_DATA_BITS;
-
-	res = __bignum_push(&result->num, (__bignum_data_t)mantissa);
+	const char *digits = (flags & FLAG_LARGE_DIGITS) ? largeDigits : smallDigits;
+	char buf[32], *p = buf, *end = buf + sizeof(buf);
+	int exp = (num64 >> DOUBLE_EXP_SHIFT) & 0x7ff, ndigits, zeros = 0, padLen, ret, i;
+	uint64_t mant = num64 & DOUBLE_MANTISSA_MASK, rem, half;
 
-	if (res < 0) {
-		format_bigdoubleDestroy(result);
-		return res;
+	if (exp != 0) {
+		mant |= 1LLU << DOUBLE_EXP_SHIFT;
+		exp -= 1023;
 	}
-
-	if (isSubnormalOrZero != 0) {
-		exp = -1022;
+	else {
+		exp = (mant != 0) ? -1022 : 0;
 	}
 
-	/* Check if there is no fractional part */
-	if (DOUBLE_EXP_SHIFT < exp) {
-		result->firstIntegerBit = 0;
-		res = __bignum_shiftl(&result->num, exp - DOUBLE_EXP_SHIFT);
-		if (res < 0) {
-			format_bigdoubleDestroy(result);
-			return res;
+	/* Round to nearest, ties to even */
+	ndigits = HEXDOUBLE_SUFFICIENT_PRECISION;
+	if (precision < HEXDOUBLE_SUFFICIENT_PRECISION) {
+		ndigits = precision;
+		rem = mant & ((1LLU << (4 * (HEXDOUBLE_SUFFICIENT_PRECISION - ndigits))) - 1);
+		half = 1LLU << (4 * (HEXDOUBLE_SUFFICIENT_PRECISION - ndigits) - 1);
+		mant >>= 4 * (HEXDOUBLE_SUFFICIENT_PRECISION - ndigits);
+		if ((rem > half) || ((rem == half) && ((mant & 1) != 0))) {
+			mant++;
 		}
 	}
 	else {
-		result->firstIntegerBit = DOUBLE_EXP_SHIFT - exp;
+		zeros = precision - HEXDOUBLE_SUFFICIENT_PRECISION;
 	}
-	return res;
-}
-
 
-static void format_bufferReverse(char *buff, size_t start, size_t end)
-{
-	char tmp;
-	end -= 1;
-	for (; start < end; ++start, --end) {
-		tmp = buff[start];
-		buff[start] = buff[end];
-		buff[end] = tmp;
-	}
-}
-
-
-static int format_sprintfDecimalForm(struct buffer *buff, struct bigdouble *bd, uint32_t flags, int precision, unsigned int *startOffset)
-{
-	char *carrier;
-	unsigned int removeTrailingZeros = flags & FLAG_NO_TRAILING_ZEROS && !(flags & FLAG_ALTERNATE);
-	unsigned int carry = 0;
-	uint32_t remainder;
-	int i, length, ret;
-
-	/* Reserve space for potential additional digit, due to carry. For example: 99.996 -> 100.00 */
-	CHECK_FAIL(ret, format_bufferAddChar(buff, 0));
-
-	*startOffset = 1;
-
-	CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
-	format_bigdoubleCutIntegerPart(bd);
-
-	/* Integer part */
-	length = 0;
-	do {
-		__bignum_div(&bd->helper1, &remainder, 10);
-		CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[remainder]));
-		length += 1;
-	} while (__bignum_cmp(&bd->helper1, 0) != 0);
-
-	format_bufferReverse(buff->data, *startOffset, *startOffset + length);
-
-	/* Frac part */
+	*p++ = digits[mant >> (4 * ndigits)];
 	if ((precision > 0) || ((flags & FLAG_ALTERNATE) != 0)) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, '.'));
+		*p++ = '.';
 	}
-	for (i = 0; i < precision; ++i) {
-		CHECK_FAIL(ret, __bignum_mul(&bd->num, 10));
-
-		CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
-
-		format_bigdoubleCutIntegerPart(bd);
-
-		CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[bd->helper1.data[0] % 10]));
+	for (i = ndigits - 1; i >= 0; --i) {
+		*p++ = digits[(mant >> (4 * i)) & 0xf];
 	}
-	/* Rounding */
-	CHECK_FAIL(ret, __bignum_mul(&bd->num, 10));
 
-	CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
+	/* Exponent is stored backwards from the end of the buffer */
+	end = __utoa_dec32((exp < 0) ? -exp : exp, end);
+	*--end = (exp < 0) ? '-' : '+';
+	*--end = (flags & FLAG_LARGE_DIGITS) ? 'P' : 'p';
 
-	format_bigdoubleCutIntegerPart(bd);
-	if (bd->helper1.data[0] % 10 >= 5) {
-		carry = 1;
+	/* Zero padding follows the prefix */
+	padLen = minFieldWidth - 2 - (p - buf) - zeros - (buf + sizeof(buf) - end) - (sign ? 1 : 0);
+	CHECK_FAIL(ret, format_printHead(ctx, feed, flags, padLen, sign, (flags & FLAG_LARGE_DIGITS) ? "0X" : "0x"));
+	CHECK_FAIL(ret, feed(ctx, buf, p - buf, 0));
+	if (zeros > 0) {
+		CHECK_FAIL(ret, feed(ctx, NULL, zeros, '0'));
 	}
+	CHECK_FAIL(ret, feed(ctx, end, buf + sizeof(buf) - end, 0));
+	CHECK_FAIL(ret, format_printTail(ctx, feed, flags, padLen));
 
-	carrier = buff->data + buff->len - 1;
-	while (carry != 0) {
-		if (*carrier == 0) {
-			*carrier = '1';
-			*startOffset = 0;
-			carry = 0;
-		}
-		else if (*carrier == '9') {
-			*(carrier--) = '0';
-		}
-		else if (('0' <= *carrier) && (*carrier <= '8')) {
-			*carrier = *carrier + 1;
-			carry = 0;
-		}
-		else {
-			carrier--;
-		}
-	}
-	if (((precision > 0) || ((flags & FLAG_ALTERNATE) != 0)) && (removeTrailingZeros != 0)) {
-		--buff->len;
-		while (buff->data[buff->len] == '0')
-			--buff->len;
-		if (buff->data[buff->len] == '.') {
-			--buff->len;
-		}
-		++buff->len;
-	}
 	return 0;
 }
 
 
-static int format_sprintfHexadecimalForm(struct buffer *buff, double d, uint32_t flags, const int precision, unsigned int *startOffset)
+/* Outputs up to 9 digits of a word, all of them (with leading zeros) unless it is the leading word */
+static int format_feedWord(void *ctx, feedfunc feed, uint32_t word, int leading, int ndigits)
 {
-	const char *const digits = (flags & FLAG_LARGE_DIGITS) != 0 ? largeDigits : smallDigits;
-	uint32_t temp, carry = 0;
-	uint64_t num64 = format_u64FromDouble(d);
-	size_t currSize;
-	int32_t exp = format_doubleGetExponent(num64);
-	int i, ret;
-
-	for (i = 0; i < 5; ++i) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, 0));
-	}
-	*startOffset = 5;
-
-	for (i = 0; i < precision - HEXDOUBLE_SUFFICIENT_PRECISION; ++i) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, 0));
-	}
+	char buf[9], *s = __utoa_dec32(word, buf + sizeof(buf));
 
-	for (i = 0; i < HEXDOUBLE_SUFFICIENT_PRECISION; ++i) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, num64 % 16));
-		num64 /= 16;
+	if (leading == 0) {
+		memset(buf, '0', s - buf);
+		s = buf;
 	}
 
-	format_bufferReverse(buff->data, *startOffset, buff->len);
+	return feed(ctx, s, min(ndigits, buf + sizeof(buf) - s), 0);
+}
 
-	*startOffset -= 1;
-	buff->data[*startOffset] = exp == -1023 ? 0 : 1;
 
-	if (precision < HEXDOUBLE_SUFFICIENT_PRECISION) {
-		i = *startOffset + precision;
-		temp = buff->data[i + 1];
-		if (temp >= 8) {
-			carry = 1;
-		}
-		while (carry != 0) {
-			if (buff->data[i] != 15) {
-				buff->data[i] += 1;
-				carry = 0;
-			}
-			else {
-				buff->data[i] = 0;
-			}
-			i -= 1;
-		}
-		if (i < *startOffset - 1) {
-			*startOffset = *startOffset - 1;
-		}
-	}
-	for (i = *startOffset; i <= *startOffset + precision; ++i) {
-		temp = buff->data[i];
-		buff->data[i] = digits[temp];
+static int format_sprintfDouble(void *ctx, feedfunc feed, double d, uint32_t flags, int minFieldWidth, int precision, char format)
+{
+	uint32_t big[FP_WORDS], *a, *r, *z, *b, *w;
+	uint32_t carry, rm, x, i;
+	uint64_t num64 = format_u64FromDouble(d), m;
+	char sign, dbuf[9], ebuf[8], *estr = ebuf + sizeof(ebuf), *s;
+	const char *chosen;
+	int e2, e, j, sh, need, len, padLen, ret, sticky = 0, up, more;
+
+	/* check sign, if FLAG_PLUS and FLAG_SPACE both appear, then ignore SPACE */
+	if ((num64 >> 63) != 0) {
+		sign = '-';
 	}
-
-	buff->len = *startOffset + 1 + precision;
-
-	if (!((precision == 0) && ((flags & FLAG_ALTERNATE) == 0))) {
-		*startOffset -= 1;
-		buff->data[*startOffset] = buff->data[*startOffset + 1];
-		buff->data[*startOffset + 1] = '.';
+	else if ((flags & FLAG_PLUS) != 0) {
+		sign = '+';
 	}
-	*startOffset -= 1;
-	buff->data[*startOffset] = (flags & FLAG_LARGE_DIGITS) != 0 ? 'X' : 'x';
-	*startOffset -= 1;
-	buff->data[*startOffset] = '0';
-
-	CHECK_FAIL(ret, format_bufferAddChar(buff, ((flags & FLAG_LARGE_DIGITS) != 0) ? 'P' : 'p'));
-
-	if (exp < 0) {
-		if (exp == -1023) {
-			exp = -1022;
-		}
-		exp = -exp;
-		CHECK_FAIL(ret, format_bufferAddChar(buff, '-'));
+	else if ((flags & FLAG_SPACE) != 0) {
+		sign = ' ';
 	}
 	else {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, '+'));
+		sign = '\0';
 	}
-	if (exp > 0) {
-		currSize = buff->len;
-		for (; exp > 0; exp /= 10) {
-			CHECK_FAIL(ret, format_bufferAddChar(buff, digits[exp % 10]));
+	num64 &= ~(1LLU << 63);
+
+	/* check special cases */
+	if ((num64 >> DOUBLE_EXP_SHIFT) == 0x7ff) {
+		/* for NaN and infinity, flags '#' and '0' have no effect */
+		flags &= ~(FLAG_ZERO | FLAG_ALTERNATE);
+		if ((num64 & DOUBLE_MANTISSA_MASK) == 0) {
+			chosen = (flags & FLAG_LARGE_DIGITS) ? "INF" : "inf";
+		}
+		else {
+			chosen = (flags & FLAG_LARGE_DIGITS) ? "NAN" : "nan";
 		}
 
-		format_bufferReverse(buff->data, currSize, buff->len);
-	}
-	else {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, digits[0]));
+		return format_printBuffer(ctx, feed, flags, minFieldWidth, chosen, chosen + 3, sign);
 	}
-	return 0;
-}
 
+	if (format == 'a') {
+		return format_sprintfHex(ctx, feed, num64, flags, minFieldWidth, (precision >= 0) ? precision : HEXDOUBLE_SUFFICIENT_PRECISION, sign);
+	}
 
-static int format_sprintfScientificForm(struct buffer *buff, struct bigdouble *bd, uint32_t flags, const int precision, unsigned int *startOffset, int *exp)
-{
-	char *carrier;
-	unsigned int removeTrailingZeros = flags & FLAG_NO_TRAILING_ZEROS && !(flags & FLAG_ALTERNATE);
-	unsigned int expIsPositive, carry = 0;
-	uint32_t remainder;
-	uint32_t temp;
-	int i, localexp = 0, ret;
-
-	/* Reserve space for potential additional digit (carry) and for a dot. */
-	for (i = 0; i < 2; ++i) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, 0));
+	precision = (precision >= 0) ? precision : 6;
+	if (precision > INT_MAX - 400) {
+		return -EOVERFLOW;
 	}
-	*startOffset = 2;
-
-	CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
-	format_bigdoubleCutIntegerPart(bd);
-
-	/* Integer part */
-	ret = __bignum_cmp(&bd->helper1, 0);
-	if (ret != 0) {
-		expIsPositive = 1;
-		do {
-			__bignum_div(&bd->helper1, &remainder, 10);
-			CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[remainder]));
-			localexp += 1;
-		} while (__bignum_cmp(&bd->helper1, 0) != 0);
-		format_bufferReverse(buff->data, *startOffset, localexp + *startOffset);
-		localexp--;
+
+	/* d = m * 2^e2 */
+	e2 = (num64 >> DOUBLE_EXP_SHIFT);
+	m = num64 & DOUBLE_MANTISSA_MASK;
+	if (e2 != 0) {
+		m |= 1LLU << DOUBLE_EXP_SHIFT;
+		e2 -= 1023 + DOUBLE_EXP_SHIFT;
 	}
 	else {
-		expIsPositive = 0;
-		do {
-			CHECK_FAIL(ret, __bignum_mul(&bd->num, 10));
-			CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
-			format_bigdoubleCutIntegerPart(bd);
-			temp = bd->helper1.data[0] % 10;
-			--localexp;
-		} while (temp == 0);
-		CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[temp]));
+		e2 = 1 - 1023 - DOUBLE_EXP_SHIFT;
 	}
 
-	for (i = 0; i <= precision; ++i) {
-		CHECK_FAIL(ret, __bignum_mul(&bd->num, 10));
-		CHECK_FAIL(ret, format_bigdoubleIntegerPart(bd, &bd->helper1));
-		format_bigdoubleCutIntegerPart(bd);
-		CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[bd->helper1.data[0] % 10]));
+	if (m == 0) {
+		e2 = 0;
+	}
+	while ((e2 < 0) && ((m & 1) == 0)) {
+		m >>= 1;
+		e2++;
 	}
 
-	/* Remove garbage digits */
-	buff->len = *startOffset + precision + 2;
-
-	/* Rounding */
-	if (buff->data[*startOffset + precision + 1] - '0' >= 5) {
-		carry = 1;
+	/*
+	 * The expansion occupies words [a, z), r is the word of units. Multiplication grows
+	 * the integer part towards the array start, division appends fraction words.
+	 */
+	a = (e2 < 0) ? big : big + FP_WORDS - 2;
+	a[0] = (uint32_t)(m / FP_BASE);
+	a[1] = (uint32_t)(m % FP_BASE);
+	r = a + 1;
+	z = a + 2;
+	if (a[0] == 0) {
+		a++;
 	}
-	buff->len -= 1;
-	carrier = buff->data + buff->len - 1;
-	while (carry != 0) {
-		if (*carrier == 0) {
-			*carrier = '1';
-			*startOffset -= 1;
-			carry = 0;
-			localexp += 1;
-			buff->len -= 1;
-			if (localexp == 0) {
-				expIsPositive = 1;
-			}
-		}
-		else if (*carrier == '9') {
-			*(carrier--) = '0';
+
+	/* Words are scaled by 4 at most, so that carries stay within 32 bits */
+	while (e2 > 0) {
+		sh = min(2, e2);
+		carry = 0;
+		for (w = z - 1; w >= a; w--) {
+			x = (*w << sh) + carry;
+			carry = x / FP_BASE;
+			*w = x - carry * FP_BASE;
 		}
-		else if (('0' <= *carrier) && (*carrier <= '8')) {
-			*carrier = *carrier + 1;
-			carry = 0;
+		if (carry != 0) {
+			*--a = carry;
 		}
-		else {
-			carrier--;
+		while ((z > a) && (z[-1] == 0)) {
+			z--;
 		}
+		e2 -= sh;
 	}
 
-	if ((precision > 0) || ((flags & FLAG_ALTERNATE) != 0)) {
-		/* Insert a dot */
-		*startOffset -= 1;
-		buff->data[*startOffset] = buff->data[*startOffset + 1];
-		buff->data[*startOffset + 1] = '.';
-
-		if (removeTrailingZeros != 0) {
-			--buff->len;
-			while (buff->data[buff->len] == '0') {
-				--buff->len;
-			}
-			if (buff->data[buff->len] == '.') {
-				--buff->len;
-			}
-			++buff->len;
+	need = 1 + (min(precision, FP_PREC_MAX) + DOUBLE_EXP_SHIFT / 3 + 8) / 9;
+	while (e2 < 0) {
+		sh = min(9, -e2);
+		carry = 0;
+		for (w = a; w < z; w++) {
+			rm = *w & ((1u << sh) - 1);
+			*w = (*w >> sh) + carry;
+			carry = (FP_BASE >> sh) * rm;
+		}
+		if (*a == 0) {
+			a++;
+		}
+		if (carry != 0) {
+			*z++ = carry;
 		}
-	}
-	CHECK_FAIL(ret, format_bufferAddChar(buff, flags & FLAG_LARGE_DIGITS ? 'E' : 'e'));
-	CHECK_FAIL(ret, format_bufferAddChar(buff, expIsPositive ? '+' : '-'));
 
-	*exp = localexp;
-	if (expIsPositive == 0) {
-		localexp = -localexp;
+		/* Digits past the requested precision only matter for rounding */
+		b = (format == 'f') ? r : a;
+		if (z - b > need) {
+			for (w = b + need; w < z; w++) {
+				sticky |= (*w != 0);
+			}
+			z = b + need;
+		}
+		e2 += sh;
 	}
-	i = buff->len;
-	CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[localexp % 10]));
 
-	localexp /= 10;
-	if (localexp == 0) {
-		CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[0]));
-	}
-	else {
-		while (localexp != 0) {
-			CHECK_FAIL(ret, format_bufferAddChar(buff, smallDigits[localexp % 10]));
-			localexp /= 10;
+	/* Decimal exponent of the leading digit */
+	e = 0;
+	if (a < z) {
+		for (i = 10, e = 9 * (r - a); *a >= i; i *= 10, e++) {
 		}
 	}
-	format_bufferReverse(buff->data, i, buff->len);
 
-	return 0;
-}
+	/* Round to nearest, ties to even, j digits after the radix point are kept */
+	j = min(precision, FP_PREC_MAX) - ((format != 'f') ? e : 0) - (((format == 'g') && (precision != 0)) ? 1 : 0);
+	if (j < 9 * (z - r - 1)) {
+		w = r + 1 + ((j + 9 * FP_WORDS) / 9 - FP_WORDS);
+		j = (j + 9 * FP_WORDS) % 9;
+		for (i = 10, j++; j < 9; i *= 10, j++) {
+		}
+		x = *w % i;
 
+		more = sticky;
+		for (b = w + 1; b < z; b++) {
+			more |= (*b != 0);
+		}
 
-static int format_sprintfDouble(void *ctx, feedfunc feed, double d, uint32_t flags, int minFieldWidth, int precision, char format)
-{
-	struct buffer buff;
-	char sign = 0;
-	const char *chosen, *infinity = (flags & FLAG_LARGE_DIGITS) ? "INF" : "inf",
-						*notNumber = (flags & FLAG_LARGE_DIGITS) ? "NAN" : "nan";
-	uint64_t num64 = format_u64FromDouble(d);
-	unsigned int startOffset = 0;
-	int i, prec, exp, ret = 0;
-	struct bigdouble bd, bd_backup;
-
-	if (format != 'a') {
-		precision = precision >= 0 ? precision : 6;
-	}
-	else {
-		precision = precision >= 0 ? precision : HEXDOUBLE_SUFFICIENT_PRECISION;
-	}
+		if ((x != 0) || (more != 0)) {
+			if (x != i / 2) {
+				up = x > i / 2;
+			}
+			else if (more != 0) {
+				up = 1;
+			}
+			else if (i == FP_BASE) {
+				up = (w > a) && ((w[-1] & 1) != 0);
+			}
+			else {
+				up = ((*w / i) & 1) != 0;
+			}
 
-	/* check sign */
-	if (((num64 >> 63) & 1) != 0) {
-		sign = '-';
-		d = -d;
-	}
-	else if ((flags & FLAG_PLUS) != 0) {
-		sign = '+';
-	}
-	else if ((flags & FLAG_SPACE) != 0) { /* If FLAG_PLUS and FLAG_SPACE both appear, then ignore SPACE */
-		sign = ' ';
+			*w -= x;
+			if (up != 0) {
+				*w += i;
+				while (*w >= FP_BASE) {
+					*w-- = 0;
+					if (w < a) {
+						*--a = 0;
+					}
+					(*w)++;
+				}
+				for (i = 10, e = 9 * (r - a); *a >= i; i *= 10, e++) {
+				}
+			}
+		}
+		if (z > w + 1) {
+			z = w + 1;
+		}
 	}
-	else {
-		sign = '\0';
+	while ((z > a) && (z[-1] == 0)) {
+		z--;
 	}
-	num64 = format_u64FromDouble(d);
 
-	CHECK_FAIL(ret, format_bufferInit(&buff, 2 * precision + 6));
+	if (format == 'g') {
+		if (precision == 0) {
+			precision = 1;
+		}
 
-	/* check special cases */
-	if (((num64 >> DOUBLE_EXP_SHIFT) & 0x7ff) == 0x7ff) {
-		/* for NaN and infinity, flags '#' and '0' have no effect */
-		flags &= ~(FLAG_ZERO | FLAG_ALTERNATE);
-		if ((num64 & 0xfffffffffffff) == 0) {
-			chosen = infinity;
+		if ((precision > e) && (e >= -4)) {
+			format = 'f';
+			precision -= e + 1;
 		}
 		else {
-			chosen = notNumber;
+			format = 'e';
+			precision--;
 		}
 
-		ret = format_printBuffer(ctx, feed, flags, minFieldWidth, chosen, chosen + strlen(chosen), sign);
-		format_bufferDestroy(&buff);
-
-		return ret;
-	}
-
-	/* check zero */
-	if ((num64 & 0x7fffffffffffffff) == 0) {
-		ret = format_bufferAddChar(&buff, '0');
-		if (ret < 0) {
-			format_bufferDestroy(&buff);
-			return ret;
-		}
-		if (format == 'a') {
-			ret = format_bufferAddChar(&buff, (flags & FLAG_LARGE_DIGITS) ? 'X' : 'x');
-			if (ret < 0) {
-				format_bufferDestroy(&buff);
-				return ret;
-			}
-			ret = format_bufferAddChar(&buff, '0');
-			if (ret < 0) {
-				format_bufferDestroy(&buff);
-				return ret;
-			}
-		}
-		if (((flags & FLAG_ALTERNATE) != 0) || ((format != 'g') && (precision > 0))) {
-			ret = format_bufferAddChar(&buff, '.');
-			if (ret < 0) {
-				format_bufferDestroy(&buff);
-				return ret;
-			}
-			if (format == 'g') {
-				precision = precision ? precision - 1 : 0;
-			}
-			for (i = 0; i < precision; i++) {
-				ret = format_bufferAddChar(&buff, '0');
-				if (ret < 0) {
-					format_bufferDestroy(&buff);
-					return ret;
+		if ((flags & FLAG_ALTERNATE) == 0) {
+			/* Trailing zeros are removed */
+			if ((z > a) && (z[-1] != 0)) {
+				for (i = 10, j = 0; (z[-1] % i) == 0; i *= 10, j++) {
 				}
 			}
-		}
-		if (format == 'e') {
-			ret = format_bufferAddChar(&buff, (flags & FLAG_LARGE_DIGITS) ? 'E' : 'e');
-			if (ret < 0) {
-				format_bufferDestroy(&buff);
-				return ret;
-			}
-			for (i = 0; i < 3; ++i) {
-				ret = format_bufferAddChar(&buff, "+00"[i]);
-				if (ret < 0) {
-					format_bufferDestroy(&buff);
-					return ret;
-				}
+			else {
+				j = 9;
 			}
-		}
-		if (format == 'a') {
-			ret = format_bufferAddChar(&buff, (flags & FLAG_LARGE_DIGITS) ? 'P' : 'p');
-			if (ret < 0) {
-				format_bufferDestroy(&buff);
-				return ret;
+
+			if (format == 'f') {
+				precision = max(0, min(precision, 9 * (z - r - 1) - j));
 			}
-			for (i = 0; i < 2; ++i) {
-				ret = format_bufferAddChar(&buff, "+0"[i]);
-				if (ret < 0) {
-					format_bufferDestroy(&buff);
-					return ret;
-				}
+			else {
+				precision = max(0, min(precision, 9 * (z - r - 1) + e - j));
 			}
 		}
-
-		ret = format_printBuffer(ctx, feed, flags, minFieldWidth, buff.data, buff.data + buff.len, sign);
-
-		format_bufferDestroy(&buff);
-
-		return ret;
-	}
-
-	ret = format_bigdoubleLoad(&bd, d);
-	if (ret < 0) {
-		format_bufferDestroy(&buff);
-		return ret;
 	}
 
+	len = 1 + precision + (((precision != 0) || ((flags & FLAG_ALTERNATE) != 0)) ? 1 : 0);
 	if (format == 'f') {
-		ret = format_sprintfDecimalForm(&buff, &bd, flags, precision, &startOffset);
+		if (e > 0) {
+			len += e;
+		}
 	}
-	else if (format == 'e') {
-		ret = format_sprintfScientificForm(&buff, &bd, flags, precision, &startOffset, &exp);
+	else {
+		estr = __utoa_dec32((e < 0) ? -e : e, estr);
+		if (ebuf + sizeof(ebuf) - estr < 2) {
+			*--estr = '0';
+		}
+		*--estr = (e < 0) ? '-' : '+';
+		*--estr = (flags & FLAG_LARGE_DIGITS) ? 'E' : 'e';
+		len += ebuf + sizeof(ebuf) - estr;
 	}
-	else if (format == 'g') {
-		ret = format_bigdoubleInit(&bd_backup, BIGDOUBLE_DEFAULT_SIZE);
-		if (ret < 0) {
-			format_bufferDestroy(&buff);
-			format_bigdoubleDestroy(&bd);
-			return ret;
+
+	padLen = minFieldWidth - len - (sign ? 1 : 0);
+	CHECK_FAIL(ret, format_printHead(ctx, feed, flags, padLen, sign, NULL));
+
+	if (format == 'f') {
+		if (a > r) {
+			a = r;
 		}
-		ret = __bignum_copy(&bd_backup.num, &bd.num);
-		if (ret < 0) {
-			format_bigdoubleDestroy(&bd_backup);
-			format_bufferDestroy(&buff);
-			format_bigdoubleDestroy(&bd);
-			return ret;
+		for (w = a; w <= r; w++) {
+			CHECK_FAIL(ret, format_feedWord(ctx, feed, *w, w == a, 9));
 		}
-		bd_backup.firstIntegerBit = bd.firstIntegerBit;
-
-		prec = precision ? precision : 1;
-		ret = format_sprintfScientificForm(&buff, &bd_backup, flags, prec - 1, &startOffset, &exp);
-		if (ret == 0) {
-			if ((prec > exp) && (exp >= -4)) {
-				buff.len = 0;
-				precision = prec - (exp + 1);
-				ret = format_sprintfDecimalForm(&buff, &bd, flags, precision, &startOffset);
-			}
+		if ((precision != 0) || ((flags & FLAG_ALTERNATE) != 0)) {
+			CHECK_FAIL(ret, feed(ctx, ".", 1, 0));
 		}
-
-		format_bigdoubleDestroy(&bd_backup);
 	}
 	else {
-		ret = format_sprintfHexadecimalForm(&buff, d, flags, precision, &startOffset);
+		/* Leading digit, the rest of the leading word follows the radix point */
+		s = __utoa_dec32((a < z) ? *a : 0, dbuf + sizeof(dbuf));
+		CHECK_FAIL(ret, feed(ctx, s++, 1, 0));
+		if ((precision != 0) || ((flags & FLAG_ALTERNATE) != 0)) {
+			CHECK_FAIL(ret, feed(ctx, ".", 1, 0));
+		}
+		len = min(precision, dbuf + sizeof(dbuf) - s);
+		if (len > 0) {
+			CHECK_FAIL(ret, feed(ctx, s, len, 0));
+		}
+		precision -= len;
+		w = a + 1;
 	}
 
-	if (ret == 0) {
-		ret = format_printBuffer(ctx, feed, flags, minFieldWidth, buff.data + startOffset, buff.data + buff.len, sign);
+	for (; (w < z) && (precision > 0); w++, precision -= 9) {
+		CHECK_FAIL(ret, format_feedWord(ctx, feed, *w, 0, precision));
+	}
+	if (precision > 0) {
+		CHECK_FAIL(ret, feed(ctx, NULL, precision, '0'));
 	}
-	format_bufferDestroy(&buff);
-	format_bigdoubleDestroy(&bd);
 
-	return ret;
+	if (format == 'e') {
+		CHECK_FAIL(ret, feed(ctx, estr, ebuf + sizeof(ebuf) - estr, 0));
+	}
+
+	return format_printTail(ctx, feed, flags, padLen);
 }
+
+
 #endif /* IO_NO_FLOAT */
 
 
 static int format_sprintf_num(void *ctx, feedfunc feed, uint64_t num64, uint32_t flags, int minFieldWidth, int precision)
 {
 	const char *digits = (flags & FLAG_LARGE_DIGITS) ? largeDigits : smallDigits,
-			   *prefix = (flags & FLAG_LARGE_DIGITS) ? "X0" : "x0";
+			   *prefix = (flags & FLAG_LARGE_DIGITS) ? "0X" : "0x";
 	char tmp_buf[32];
 	char sign = 0;
-	char *tmp = tmp_buf;
+	char *const end = tmp_buf + sizeof(tmp_buf);
+	char *tmp = end; /* Digits are stored from the least significant one backwards */
 	int i, ret;
 	uint32_t num32 = (uint32_t)num64;
 	uint32_t num_high = (uint32_t)(num64 >> 32);
@@ -863,23 +592,23 @@ static int format_sprintf_num(void *ctx, feedfunc feed, uint64_t num64, uint32_t
 
 	if (num64 == 0) {
 		if (precision > 0) {
-			*tmp++ = '0';
+			*--tmp = '0';
 		}
 	}
 	else if ((flags & FLAG_HEX) != 0) {
 		if ((flags & FLAG_64BIT) != 0) {
 			for (i = 0; i < 8; ++i) {
-				*tmp++ = digits[num32 & 0x0f];
+				*--tmp = digits[num32 & 0x0f];
 				num32 >>= 4;
 			}
 			while (num_high != 0) {
-				*tmp++ = digits[num_high & 0x0f];
+				*--tmp = digits[num_high & 0x0f];
 				num_high >>= 4;
 			}
 		}
 		else {
 			while (num32 != 0) {
-				*tmp++ = digits[num32 & 0x0f];
+				*--tmp = digits[num32 & 0x0f];
 				num32 >>= 4;
 			}
 		}
@@ -888,56 +617,45 @@ static int format_sprintf_num(void *ctx, feedfunc feed, uint64_t num64, uint32_t
 		if ((flags & FLAG_64BIT) != 0) {
 			// 30 bits
 			for (i = 0; i < 10; ++i) {
-				*tmp++ = digits[num32 & 0x07];
+				*--tmp = digits[num32 & 0x07];
 				num32 >>= 3;
 			}
 			// 31, 32 bit from num32, bit 0 from num_high
 			num32 |= (num_high & 0x1) << 2;
-			*tmp++ = digits[num32 & 0x07];
+			*--tmp = digits[num32 & 0x07];
 			num_high >>= 1;
 
 			while (num_high != 0) {
-				*tmp++ = digits[num_high & 0x07];
+				*--tmp = digits[num_high & 0x07];
 				num_high >>= 3;
 			}
 		}
 		else {
 			while (num32 != 0) {
-				*tmp++ = digits[num32 & 0x07];
+				*--tmp = digits[num32 & 0x07];
 				num32 >>= 3;
 			}
 		}
 	}
 	else {
-		if ((flags & FLAG_64BIT) != 0) {  // TODO: optimize
-			while (num64 != 0) {
-				*tmp++ = digits[num64 % 10];
-				num64 /= 10;
-			}
-		}
-		else {
-			while (num32 != 0) {
-				*tmp++ = digits[num32 % 10];
-				num32 /= 10;
-			}
-		}
+		tmp = ((flags & FLAG_64BIT) != 0) ? __utoa_dec64(num64, end) : __utoa_dec32(num32, end);
 	}
 
 	if (((flags & FLAG_OCT) != 0) && ((num64 != 0) || (precision == 0)) && ((flags & FLAG_ALTERNATE) != 0)) {
-		*tmp++ = '0';
+		*--tmp = '0';
 	}
 
-	if (tmp - tmp_buf < precision) {
-		memset(tmp, '0', precision - (tmp - tmp_buf));
-		tmp = tmp_buf + precision;
+	if (end - tmp < precision) {
+		memset(end - precision, '0', precision - (end - tmp));
+		tmp = end - precision;
 	}
 
 	if (((flags & FLAG_HEX) != 0) && (num64 != 0) && ((flags & FLAG_ALTERNATE) != 0)) {
-		*tmp++ = prefix[0];
-		*tmp++ = prefix[1];
+		*--tmp = prefix[1];
+		*--tmp = prefix[0];
 	}
 
-	CHECK_FAIL(ret, format_printBuffer(ctx, feed, flags, minFieldWidth, tmp, tmp_buf, sign));
+	CHECK_FAIL(ret, format_printBuffer(ctx, feed, flags, minFieldWidth, tmp, end, sign));
 
 	return 0;
 }
@@ -960,14 +678,19 @@ int format_parse(void *ctx, feedfunc feed, const char *format, va_list args)
 			break;
 		}
 
+		/* literal text up to the next conversion */
 		if (fmt != '%') {
-			CHECK_FAIL(ret, feed(ctx, fmt));
+			s = format - 1;
+			while ((*format != '\0') && (*format != '%')) {
+				format++;
+			}
+			CHECK_FAIL(ret, feed(ctx, s, format - s, 0));
 			continue;
 		}
 
 		fmt = *format++;
 		if (fmt == '\0') {
-			CHECK_FAIL(ret, feed(ctx, '%'));
+			CHECK_FAIL(ret, feed(ctx, "%", 1, 0));
 			break;
 		}
 
@@ -1202,17 +925,17 @@ int format_parse(void *ctx, feedfunc feed, const char *format, va_list args)
 				else {
 					va_arg((args), double);
 				}
-				CHECK_FAIL(ret, feed(ctx, '%'));
-				CHECK_FAIL(ret, feed(ctx, fmt));
+				CHECK_FAIL(ret, feed(ctx, "%", 1, 0));
+				CHECK_FAIL(ret, feed(ctx, &fmt, 1, 0));
 				break;
 #endif
 			}
 			case '%':
-				CHECK_FAIL(ret, feed(ctx, '%'));
+				CHECK_FAIL(ret, feed(ctx, "%", 1, 0));
 				break;
 			default:
-				CHECK_FAIL(ret, feed(ctx, '%'));
-				CHECK_FAIL(ret, feed(ctx, fmt));
+				CHECK_FAIL(ret, feed(ctx, "%", 1, 0));
+				CHECK_FAIL(ret, feed(ctx, &fmt, 1, 0));
 				break;
 		}
 	}
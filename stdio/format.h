@@ -17,13 +17,15 @@
 #define _LIBPHOENIX_STDIO_FORMAT_H
 
 #include <stdarg.h>
+#include <stddef.h>
 
 
 #define FORMAT_NIL_STR     "(nil)"
 #define FORMAT_NIL_STR_LEN (sizeof(FORMAT_NIL_STR) - 1)
 
 
-typedef int (*feedfunc)(void *, char);
+/* Outputs len bytes of str, or len copies of fill if str is NULL */
+typedef int (*feedfunc)(void *ctx, const char *str, size_t len, char fill);
 
 
 extern int format_parse(void *ctx, feedfunc feed, const char *format, va_list args);
@@ -18,6 +18,8 @@
 #include "stdlib.h"
 #include "unistd.h"
 #include "format.h"
+#include "string.h"
+#include "sys/minmax.h"
 #include "sys/debug.h"
 
 #include "../unistd/file-internal.h"
@@ -34,34 +36,69 @@ struct feed_ctx_s {
 	size_t total;
 	int error;
 	enum { feed_hStream = 0, feed_hDescriptor } hType;
-	char buff[16];
+	char buff[64];
 };
 /* clang-format on */
 
 
-static int format_feed(void *context, char c)
+static void format_write(struct feed_ctx_s *ctx, const char *str, size_t len)
 {
 	size_t res;
+
+	res = (ctx->hType == feed_hStream) ?
+			fwrite_unlocked(str, 1, len, ctx->h.stream) :
+			__safe_write(ctx->h.fd, str, len);
+
+	ctx->total += res;
+	if (len != res) {
+		ctx->error = -errno;
+	}
+}
+
+
+static int format_feed(void *context, const char *str, size_t len, char fill)
+{
 	struct feed_ctx_s *ctx = (struct feed_ctx_s *)context;
+	size_t cnt;
+
+	/* Streams are locked for the whole call, spans go straight to the stream buffer.
+	 * Unbuffered streams (stderr) are staged like descriptors, so that a call ends in one write */
+	if ((ctx->hType == feed_hStream) && (ctx->h.stream->buffer != NULL)) {
+		if (str == NULL) {
+			memset(ctx->buff, fill, min(len, sizeof(ctx->buff)));
+		}
+
+		while ((ctx->error == 0) && (len != 0)) {
+			cnt = (str != NULL) ? len : min(len, sizeof(ctx->buff));
+			format_write(ctx, (str != NULL) ? str : ctx->buff, cnt);
+			len -= cnt;
+		}
 
-	if (ctx->error < 0) {
 		return ctx->error;
 	}
 
-	ctx->buff[ctx->n++] = c;
-	ctx->buff[ctx->n] = '\0';
-
-	if (ctx->n == sizeof(ctx->buff) - 1) {
-		res = (ctx->hType == feed_hStream) ?
-				fwrite(ctx->buff, 1, ctx->n, ctx->h.stream) :
-				__safe_write(ctx->h.fd, ctx->buff, ctx->n);
+	while ((ctx->error == 0) && (len != 0)) {
+		/* Long spans are written directly */
+		if ((str != NULL) && (ctx->n == 0) && (len >= sizeof(ctx->buff))) {
+			format_write(ctx, str, len);
+			break;
+		}
 
-		ctx->total += res;
-		if (ctx->n != res) {
-			ctx->error = -errno;
+		cnt = min(len, sizeof(ctx->buff) - ctx->n);
+		if (str != NULL) {
+			memcpy(ctx->buff + ctx->n, str, cnt);
+			str += cnt;
+		}
+		else {
+			memset(ctx->buff + ctx->n, fill, cnt);
 		}
+		ctx->n += cnt;
+		len -= cnt;
 
-		ctx->n = 0;
+		if (ctx->n == sizeof(ctx->buff)) {
+			format_write(ctx, ctx->buff, ctx->n);
+			ctx->n = 0;
+		}
 	}
 
 	return ctx->error;
@@ -81,11 +118,10 @@ int fprintf(FILE *stream, const char *format, ...)
 }
 
 
-/* errno is set by `format_parse` and `fwrite`. */
+/* errno is set by `format_parse` and `fwrite_unlocked`. */
 int vfprintf(FILE *stream, const char *format, va_list arg)
 {
 	struct feed_ctx_s ctx;
-	size_t res = 0;
 	int ret;
 
 	ctx.hType = feed_hStream;
@@ -94,17 +130,19 @@ int vfprintf(FILE *stream, const char *format, va_list arg)
 	ctx.total = 0;
 	ctx.error = 0;
 
+	/* Output of a single call is not interleaved with other threads */
+	flockfile(stream);
 	ret = format_parse(&ctx, format_feed, format, arg);
-	if (ret != 0) {
-		return -1;
+	if ((ret == 0) && (ctx.error == 0) && (ctx.n != 0)) {
+		format_write(&ctx, ctx.buff, ctx.n);
 	}
+	funlockfile(stream);
 
-	if ((ctx.n != 0)) {
-		res = fwrite(ctx.buff, 1, ctx.n, ctx.h.stream);
-		ctx.total += res;
+	if ((ret != 0) || (ctx.error != 0)) {
+		return -1;
 	}
 
-	return (ctx.n == res) ? ctx.total : -1;
+	return ctx.total;
 }
 
 
@@ -0,0 +1,311 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Memory streams
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/minmax.h>
+
+
+typedef struct {
+	char *buf;
+	size_t size;
+	size_t len; /* Bytes of valid contents */
+	size_t pos;
+	int append;
+} fmem_t;
+
+
+typedef struct {
+	char **bufp;
+	size_t *sizep;
+	char *buf;
+	size_t size;
+	size_t len;
+	size_t pos;
+} memstream_t;
+
+
+/* Resolves offset relative to whence, returns -1 with errno set if the result is negative or above limit */
+static int memstream_offset(off_t *offset, int whence, size_t pos, size_t len, size_t limit)
+{
+	off_t base;
+
+	switch (whence) {
+		case SEEK_SET:
+			base = 0;
+			break;
+
+		case SEEK_CUR:
+			base = pos;
+			break;
+
+		case SEEK_END:
+			base = len;
+			break;
+
+		default:
+			errno = EINVAL;
+			return -1;
+	}
+
+	if ((*offset < -base) || (*offset > (off_t)limit - base)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*offset += base;
+
+	return 0;
+}
+
+
+static ssize_t fmem_read(void *cookie, char *buf, size_t size)
+{
+	fmem_t *f = cookie;
+
+	if (f->pos >= f->len) {
+		return 0;
+	}
+
+	size = min(size, f->len - f->pos);
+	memcpy(buf, f->buf + f->pos, size);
+	f->pos += size;
+
+	return size;
+}
+
+
+static ssize_t fmem_write(void *cookie, const char *buf, size_t size)
+{
+	fmem_t *f = cookie;
+
+	if (f->append != 0) {
+		f->pos = f->len;
+	}
+
+	if (f->pos == f->size) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	size = min(size, f->size - f->pos);
+	memcpy(f->buf + f->pos, buf, size);
+	f->pos += size;
+
+	/* Contents are kept null-terminated while there is space */
+	if (f->pos > f->len) {
+		f->len = f->pos;
+		if (f->len < f->size) {
+			f->buf[f->len] = '\0';
+		}
+	}
+
+	return size;
+}
+
+
+static int fmem_seek(void *cookie, off_t *offset, int whence)
+{
+	fmem_t *f = cookie;
+
+	if (memstream_offset(offset, whence, f->pos, f->len, f->size) < 0) {
+		return -1;
+	}
+
+	f->pos = *offset;
+
+	return 0;
+}
+
+
+static int fmem_close(void *cookie)
+{
+	free(cookie);
+
+	return 0;
+}
+
+
+FILE *fmemopen(void *buf, size_t size, const char *mode)
+{
+	static const cookie_io_functions_t io = {
+		.read = fmem_read,
+		.write = fmem_write,
+		.seek = fmem_seek,
+		.close = fmem_close
+	};
+	fmem_t *f;
+	FILE *stream;
+
+	if ((size == 0) || (mode == NULL) || (strchr("rwa", mode[0]) == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Buffer allocated on behalf of the caller is freed along with the state */
+	if ((f = malloc(sizeof(fmem_t) + ((buf == NULL) ? size : 0))) == NULL) {
+		return NULL;
+	}
+
+	f->buf = (buf == NULL) ? (char *)(f + 1) : buf;
+	f->size = size;
+	f->pos = 0;
+	f->append = (mode[0] == 'a');
+
+	if (buf == NULL) {
+		f->buf[0] = '\0';
+		f->len = (mode[0] == 'r') ? size : 0;
+	}
+	else if (mode[0] == 'r') {
+		f->len = size;
+	}
+	else if (mode[0] == 'w') {
+		f->buf[0] = '\0';
+		f->len = 0;
+	}
+	else {
+		f->len = strnlen(f->buf, size);
+		f->pos = f->len;
+	}
+
+	if ((stream = fopencookie(f, mode, io)) == NULL) {
+		free(f);
+	}
+
+	return stream;
+}
+
+
+/* Publishes the buffer, size is the length up to the current position */
+static void memstream_update(memstream_t *m)
+{
+	*m->bufp = m->buf;
+	*m->sizep = min(m->len, m->pos);
+}
+
+
+static ssize_t memstream_write(void *cookie, const char *buf, size_t size)
+{
+	memstream_t *m = cookie;
+	size_t nsize = m->size;
+	char *nbuf;
+
+	if ((m->pos >= SSIZE_MAX) || (size > SSIZE_MAX - m->pos - 1)) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	/* Room for the terminating null byte is always kept */
+	if (m->pos + size + 1 > m->size) {
+		while (m->pos + size + 1 > nsize) {
+			nsize = (nsize > SSIZE_MAX / 2) ? SSIZE_MAX : 2 * nsize;
+		}
+
+		if ((nbuf = realloc(m->buf, nsize)) == NULL) {
+			return -1;
+		}
+
+		m->buf = nbuf;
+		m->size = nsize;
+	}
+
+	/* Gap left by a seek past the end reads as zeros */
+	if (m->pos > m->len) {
+		memset(m->buf + m->len, 0, m->pos - m->len);
+	}
+
+	memcpy(m->buf + m->pos, buf, size);
+	m->pos += size;
+	if (m->pos > m->len) {
+		m->len = m->pos;
+		m->buf[m->len] = '\0';
+	}
+
+	memstream_update(m);
+
+	return size;
+}
+
+
+static int memstream_seek(void *cookie, off_t *offset, int whence)
+{
+	memstream_t *m = cookie;
+
+	if (memstream_offset(offset, whence, m->pos, m->len, SSIZE_MAX) < 0) {
+		return -1;
+	}
+
+	m->pos = *offset;
+	memstream_update(m);
+
+	return 0;
+}
+
+
+static int memstream_close(void *cookie)
+{
+	memstream_t *m = cookie;
+
+	memstream_update(m);
+	free(m);
+
+	return 0;
+}
+
+
+FILE *open_memstream(char **bufp, size_t *sizep)
+{
+	static const cookie_io_functions_t io = {
+		.read = NULL,
+		.write = memstream_write,
+		.seek = memstream_seek,
+		.close = memstream_close
+	};
+	memstream_t *m;
+	FILE *stream;
+
+	if ((bufp == NULL) || (sizep == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((m = malloc(sizeof(memstream_t))) == NULL) {
+		return NULL;
+	}
+
+	m->size = 64;
+	if ((m->buf = malloc(m->size)) == NULL) {
+		free(m);
+		return NULL;
+	}
+
+	m->buf[0] = '\0';
+	m->bufp = bufp;
+	m->sizep = sizep;
+	m->len = 0;
+	m->pos = 0;
+
+	if ((stream = fopencookie(m, "w", io)) == NULL) {
+		free(m->buf);
+		free(m);
+		return NULL;
+	}
+
+	memstream_update(m);
+
+	return stream;
+}
@@ -14,29 +14,6 @@
  */
 
 #include "stdio.h"
-#include "format.h"
-#include "sys/debug.h"
-#include "unistd.h"
-#include "errno.h"
-
-typedef struct _printf_ctx_t {
-	size_t n;
-} printf_ctx_t;
-
-
-static int printf_feed(void *context, char c)
-{
-	int ret;
-	size_t *n = context;
-
-	ret = putchar(c);
-	if (ret == EOF) {
-		return -1;
-	}
-
-	*n = *n + 1;
-	return ret;
-}
 
 
 int printf(const char *format, ...)
@@ -52,15 +29,8 @@ int printf(const char *format, ...)
 }
 
 
-/* errno is set by `format_parse` */
+/* errno is set by `vfprintf`, which copies whole spans into the stream */
 int vprintf(const char *format, va_list arg)
 {
-	size_t n = 0;
-	int ret = format_parse(&n, printf_feed, format, arg);
-	if (ret == 0) {
-		return n;
-	}
-	else {
-		return -1;
-	}
+	return vfprintf(stdout, format, arg);
 }
@@ -16,7 +16,9 @@
 #include "stdlib.h"
 #include "stdio.h"
 #include "format.h"
+#include "sys/minmax.h"
 #include "errno.h"
+#include "string.h"
 
 
 typedef struct _vsprintf_ctx_t {
@@ -32,30 +34,45 @@ typedef struct _vsnprintf_ctx_t {
 } vsnprintf_ctx_t;
 
 
-static int vsprintf_feed(void *context, char c)
+static int vsprintf_feed(void *context, const char *str, size_t len, char fill)
 {
 	vsprintf_ctx_t *ctx = (vsprintf_ctx_t *)context;
 
-	ctx->buff[ctx->n++] = c;
+	if (str != NULL) {
+		memcpy(ctx->buff + ctx->n, str, len);
+	}
+	else {
+		memset(ctx->buff + ctx->n, fill, len);
+	}
+	ctx->n += len;
 
 	return 0;
 }
 
 
-static int vsnprintf_feed(void *context, char c)
+static int vsnprintf_feed(void *context, const char *str, size_t len, char fill)
 {
 	vsnprintf_ctx_t *ctx = (vsnprintf_ctx_t *)context;
-
-	if ((ctx->n + 1) < ctx->max_len) {
-		ctx->buff[ctx->n] = c;
-	}
-	else if ((ctx->n + 1) == ctx->max_len) {
-		ctx->buff[ctx->n] = '\0';
+	size_t cnt;
+
+	if (ctx->n < ctx->max_len) {
+		/* Last byte is left for the terminating NUL */
+		cnt = min(len, ctx->max_len - ctx->n - 1);
+		if (str != NULL) {
+			memcpy(ctx->buff + ctx->n, str, cnt);
+		}
+		else {
+			memset(ctx->buff + ctx->n, fill, cnt);
+		}
+
+		if (cnt < len) {
+			ctx->buff[ctx->n + cnt] = '\0';
+		}
 	}
 
 	/* Count anyway to return the number of characters that would have been
 	 * written if buffer had been sufficiently large */
-	ctx->n++;
+	ctx->n += len;
 
 	return 0;
 }
@@ -97,7 +114,7 @@ int vsprintf(char *str, const char *format, va_list arg)
 	ctx.n = 0;
 
 	ret = format_parse(&ctx, vsprintf_feed, format, arg);
-	(void)vsprintf_feed(&ctx, '\0');
+	(void)vsprintf_feed(&ctx, "", 1, 0);
 
 	return (ret == 0) ? ctx.n - 1 : -1;
 }
@@ -113,7 +130,7 @@ int vsnprintf(char *str, size_t n, const char *format, va_list arg)
 	ctx.max_len = n;
 
 	ret = format_parse(&ctx, vsnprintf_feed, format, arg);
-	(void)vsnprintf_feed(&ctx, '\0');
+	(void)vsnprintf_feed(&ctx, "", 1, 0);
 
 	return (ret == 0) ? ctx.n - 1 : -1;
 }
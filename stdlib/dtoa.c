@@ -0,0 +1,478 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * stdlib/dtoa.c
+ *
+ * Shortest round-trip conversion of doubles (Ryu, Ulf Adams, PLDI 2018)
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utoa-internal.h"
+
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_BITS 11
+#define DOUBLE_BIAS          1023
+
+#define POW5_BITCOUNT     125
+#define POW5_INV_BITCOUNT 125
+#define POW5_SMALL        26
+
+
+/* 5^(26 * i) as 125-bit fractions, normalized to the most significant bit */
+static const uint64_t dtoa_pow5[13][2] = {
+	{ 0x0000000000000000ull, 0x1000000000000000ull },
+	{ 0x0000000000000000ull, 0x14adf4b7320334b9ull },
+	{ 0x0e549208b31adb10ull, 0x1aba4714957d300dull },
+	{ 0x6dc6ad264d8f0866ull, 0x1145b7e285bf98f5ull },
+	{ 0xeb1dbd923d8596caull, 0x1652efdc6018a1fcull },
+	{ 0xb4c1b80b22ae923cull, 0x1cda62055b2d9d83ull },
+	{ 0x5bb28b4e8f7e4c30ull, 0x12a5568b9f52f416ull },
+	{ 0xf08aed437682d4fbull, 0x1819651531f9e78full },
+	{ 0xb4ee134ad99bf150ull, 0x1f25c186a6f04c28ull },
+	{ 0x16499ecb70c25f03ull, 0x1420eb449c8842e6ull },
+	{ 0x85a56ead360865b0ull, 0x1a03fde214caf085ull },
+	{ 0x093db1d57999890bull, 0x10cfeb353a97dad8ull },
+	{ 0xcf38bb735e3f36acull, 0x15baaf44fa52673eull }
+};
+
+
+/* 2^(pow5bits(26 * i) - 1 + 125) / 5^(26 * i) + 1 */
+static const uint64_t dtoa_pow5Inv[13][2] = {
+	{ 0x0000000000000001ull, 0x2000000000000000ull },
+	{ 0x52a6c95fc0655034ull, 0x18c240c4aecb13bbull },
+	{ 0x7ca8d50071dfc806ull, 0x1327fc58da0f6ff5ull },
+	{ 0x6520247d3556476eull, 0x1da48ce468e7c702ull },
+	{ 0x6139cdd76802e6e9ull, 0x16ef5b40c2fc7779ull },
+	{ 0xf951a7ff43de8c79ull, 0x11bebdf578b2f391ull },
+	{ 0x7be8bee8d6e957e8ull, 0x1b758d848fac54b0ull },
+	{ 0x8bd3f9e999a423eaull, 0x153eda614071a3b7ull },
+	{ 0x0848f973cb3ee3ceull, 0x10701bd527b4978cull },
+	{ 0x153285ebb9efbfa2ull, 0x196fbb9bb44db44dull },
+	{ 0xadeee7f86c07b696ull, 0x13ae3591f5b4d936ull },
+	{ 0x4d686a4eaf182222ull, 0x1e74404f3daada91ull },
+	{ 0x98c0a106e09ebd9full, 0x17900ea4fda7c257ull }
+};
+
+
+/* Corrections (2 bits per power) of products of the above with dtoa_pow5Small */
+static const uint32_t dtoa_pow5Offsets[21] = {
+	0x00000000u, 0x00000000u, 0x00000000u, 0x00000000u,
+	0x40000000u, 0x59695995u, 0x55545555u, 0x56555515u,
+	0x41150504u, 0x40555410u, 0x44555145u, 0x44504540u,
+	0x45555550u, 0x40004000u, 0x96440440u, 0x55565565u,
+	0x54454045u, 0x40154151u, 0x55559155u, 0x51405555u,
+	0x00000105u
+};
+
+
+static const uint32_t dtoa_pow5InvOffsets[19] = {
+	0x54544554u, 0x04055545u, 0x10041000u, 0x00400414u,
+	0x40010000u, 0x41155555u, 0x00000454u, 0x00010044u,
+	0x40000000u, 0x44000041u, 0x50454450u, 0x55550054u,
+	0x51655554u, 0x40004000u, 0x01000001u, 0x00010500u,
+	0x51515411u, 0x05555554u, 0x00000000u
+};
+
+
+static const uint64_t dtoa_pow5Small[26] = {
+	1ull, 5ull, 25ull, 125ull, 625ull, 3125ull,
+	15625ull, 78125ull, 390625ull, 1953125ull, 9765625ull, 48828125ull,
+	244140625ull, 1220703125ull, 6103515625ull, 30517578125ull, 152587890625ull, 762939453125ull,
+	3814697265625ull, 19073486328125ull, 95367431640625ull, 476837158203125ull, 2384185791015625ull, 11920928955078125ull,
+	59604644775390625ull, 298023223876953125ull
+};
+
+
+/* Bit length of 5^e, for 0 <= e <= 3528 */
+static inline int32_t dtoa_pow5bits(int32_t e)
+{
+	return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+
+/* floor(log10(2^e)), for 0 <= e <= 1650 */
+static inline uint32_t dtoa_log10Pow2(int32_t e)
+{
+	return ((uint32_t)e * 78913) >> 18;
+}
+
+
+/* floor(log10(5^e)), for 0 <= e <= 2620 */
+static inline uint32_t dtoa_log10Pow5(int32_t e)
+{
+	return ((uint32_t)e * 732923) >> 20;
+}
+
+
+static inline uint64_t dtoa_umul128(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)a * b;
+
+	*hi = (uint64_t)(p >> 64);
+	return (uint64_t)p;
+#else
+	uint32_t aLo = (uint32_t)a, aHi = (uint32_t)(a >> 32);
+	uint32_t bLo = (uint32_t)b, bHi = (uint32_t)(b >> 32);
+	uint64_t b00 = (uint64_t)aLo * bLo, b01 = (uint64_t)aLo * bHi;
+	uint64_t b10 = (uint64_t)aHi * bLo, b11 = (uint64_t)aHi * bHi;
+	uint64_t mid1 = b10 + (b00 >> 32);
+	uint64_t mid2 = b01 + (uint32_t)mid1;
+
+	*hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+	return (mid2 << 32) | (uint32_t)b00;
+#endif
+}
+
+
+static inline uint64_t dtoa_umulh(uint64_t a, uint64_t b)
+{
+	uint64_t hi;
+
+	dtoa_umul128(a, b, &hi);
+	return hi;
+}
+
+
+/* Divisions by constants, without a 64-bit division call on 32-bit targets */
+static inline uint64_t dtoa_div5(uint64_t x)
+{
+	return dtoa_umulh(x, 0xcccccccccccccccdull) >> 2;
+}
+
+
+static inline uint64_t dtoa_div10(uint64_t x)
+{
+	return dtoa_umulh(x, 0xcccccccccccccccdull) >> 3;
+}
+
+
+static inline uint64_t dtoa_div100(uint64_t x)
+{
+	return dtoa_umulh(x >> 2, 0x28f5c28f5c28f5c3ull) >> 2;
+}
+
+
+/* (hi:lo) >> dist, for 0 < dist < 64 */
+static inline uint64_t dtoa_shiftr128(uint64_t lo, uint64_t hi, uint32_t dist)
+{
+	return (hi << (64 - dist)) | (lo >> dist);
+}
+
+
+/* Computes 5^i from the tables, 0 <= i <= 325 */
+static void dtoa_pow5Split(uint32_t i, uint64_t *res)
+{
+	uint32_t base = i / POW5_SMALL, base2 = base * POW5_SMALL, delta;
+	const uint64_t *mul = dtoa_pow5[base];
+	uint64_t m, lo0, hi0, lo1, hi1, sum;
+
+	if (i == base2) {
+		res[0] = mul[0];
+		res[1] = mul[1];
+		return;
+	}
+
+	m = dtoa_pow5Small[i - base2];
+	lo1 = dtoa_umul128(m, mul[1], &hi1);
+	lo0 = dtoa_umul128(m, mul[0], &hi0);
+	sum = hi0 + lo1;
+	if (sum < hi0)
+		++hi1;
+
+	delta = dtoa_pow5bits(i) - dtoa_pow5bits(base2);
+	res[0] = dtoa_shiftr128(lo0, sum, delta) + ((dtoa_pow5Offsets[i / 16] >> ((i % 16) << 1)) & 3);
+	res[1] = dtoa_shiftr128(sum, hi1, delta);
+}
+
+
+/* Computes 5^-i from the tables, 0 <= i <= 291 */
+static void dtoa_pow5InvSplit(uint32_t i, uint64_t *res)
+{
+	uint32_t base = (i + POW5_SMALL - 1) / POW5_SMALL, base2 = base * POW5_SMALL, delta;
+	const uint64_t *mul = dtoa_pow5Inv[base];
+	uint64_t m, lo0, hi0, lo1, hi1, sum;
+
+	if (i == base2) {
+		res[0] = mul[0];
+		res[1] = mul[1];
+		return;
+	}
+
+	m = dtoa_pow5Small[base2 - i];
+	lo1 = dtoa_umul128(m, mul[1], &hi1);
+	lo0 = dtoa_umul128(m, mul[0] - 1, &hi0);
+	sum = hi0 + lo1;
+	if (sum < hi0)
+		++hi1;
+
+	delta = dtoa_pow5bits(base2) - dtoa_pow5bits(i);
+	res[0] = dtoa_shiftr128(lo0, sum, delta) + 1 + ((dtoa_pow5InvOffsets[i / 16] >> ((i % 16) << 1)) & 3);
+	res[1] = dtoa_shiftr128(sum, hi1, delta);
+}
+
+
+static inline uint64_t dtoa_mulShift(uint64_t m, const uint64_t *mul, int32_t j)
+{
+	uint64_t hi0, hi1, lo1, sum;
+
+	dtoa_umul128(m, mul[0], &hi0);
+	lo1 = dtoa_umul128(m, mul[1], &hi1);
+	sum = hi0 + lo1;
+	if (sum < hi0)
+		++hi1;
+
+	return dtoa_shiftr128(sum, hi1, j - 64);
+}
+
+
+static inline int dtoa_multipleOfPow5(uint64_t value, uint32_t p)
+{
+	uint32_t count = 0;
+
+	for (;;) {
+		uint64_t q = dtoa_div5(value);
+
+		if ((uint32_t)value != 5 * (uint32_t)q)
+			break;
+		value = q;
+		++count;
+	}
+
+	return count >= p;
+}
+
+
+static inline int dtoa_multipleOfPow2(uint64_t value, uint32_t p)
+{
+	return (value & ((1ull << p) - 1)) == 0;
+}
+
+
+/* Finds the shortest decimal output * 10^exp within the rounding interval of m2 * 2^e2 */
+static uint64_t dtoa_d2d(uint64_t ieeeMantissa, uint32_t ieeeExponent, int32_t *exp)
+{
+	int32_t e2, e10, removed = 0, k, i;
+	uint64_t m2, mv, vr, vp, vm, output, pow5[2], vpDiv, vmDiv, vrDiv;
+	uint32_t q, mmShift, vrMod, lastRemovedDigit = 0;
+	int even, vmIsTrailingZeros = 0, vrIsTrailingZeros = 0, roundUp = 0;
+
+	if (ieeeExponent == 0) {
+		e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = ieeeMantissa;
+	}
+	else {
+		e2 = (int32_t)ieeeExponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+		m2 = (1ull << DOUBLE_MANTISSA_BITS) | ieeeMantissa;
+	}
+
+	/* Interval bounds are representable only for even mantissas */
+	even = (m2 & 1) == 0;
+	mv = 4 * m2;
+	mmShift = (ieeeMantissa != 0) || (ieeeExponent <= 1);
+
+	if (e2 >= 0) {
+		q = dtoa_log10Pow2(e2) - (e2 > 3);
+		e10 = (int32_t)q;
+		k = POW5_INV_BITCOUNT + dtoa_pow5bits(q) - 1;
+		i = -e2 + (int32_t)q + k;
+		dtoa_pow5InvSplit(q, pow5);
+		vr = dtoa_mulShift(mv, pow5, i);
+		vp = dtoa_mulShift(mv + 2, pow5, i);
+		vm = dtoa_mulShift(mv - 1 - mmShift, pow5, i);
+
+		if (q <= 21) {
+			/* Only one of mp, mv and mm can be a multiple of 5 */
+			if ((uint32_t)mv == 5 * (uint32_t)dtoa_div5(mv))
+				vrIsTrailingZeros = dtoa_multipleOfPow5(mv, q);
+			else if (even)
+				vmIsTrailingZeros = dtoa_multipleOfPow5(mv - 1 - mmShift, q);
+			else
+				vp -= dtoa_multipleOfPow5(mv + 2, q);
+		}
+	}
+	else {
+		q = dtoa_log10Pow5(-e2) - (-e2 > 1);
+		e10 = (int32_t)q + e2;
+		i = -e2 - (int32_t)q;
+		k = dtoa_pow5bits(i) - POW5_BITCOUNT;
+		dtoa_pow5Split(i, pow5);
+		vr = dtoa_mulShift(mv, pow5, (int32_t)q - k);
+		vp = dtoa_mulShift(mv + 2, pow5, (int32_t)q - k);
+		vm = dtoa_mulShift(mv - 1 - mmShift, pow5, (int32_t)q - k);
+
+		if (q <= 1) {
+			/* mv has at least 2 trailing zero bits, mp at least 1, mm one if mmShift is set */
+			vrIsTrailingZeros = 1;
+			if (even)
+				vmIsTrailingZeros = mmShift == 1;
+			else
+				--vp;
+		}
+		else if (q < 63) {
+			vrIsTrailingZeros = dtoa_multipleOfPow2(mv, q);
+		}
+	}
+
+	if (vmIsTrailingZeros || vrIsTrailingZeros) {
+		/* Exact bounds or ties, rare */
+		for (;;) {
+			vpDiv = dtoa_div10(vp);
+			vmDiv = dtoa_div10(vm);
+			if (vpDiv <= vmDiv)
+				break;
+			vrDiv = dtoa_div10(vr);
+			vrMod = (uint32_t)vr - 10 * (uint32_t)vrDiv;
+			vmIsTrailingZeros &= (uint32_t)vm == 10 * (uint32_t)vmDiv;
+			vrIsTrailingZeros &= lastRemovedDigit == 0;
+			lastRemovedDigit = vrMod;
+			vr = vrDiv;
+			vp = vpDiv;
+			vm = vmDiv;
+			++removed;
+		}
+
+		if (vmIsTrailingZeros) {
+			for (;;) {
+				vmDiv = dtoa_div10(vm);
+				if ((uint32_t)vm != 10 * (uint32_t)vmDiv)
+					break;
+				vpDiv = dtoa_div10(vp);
+				vrDiv = dtoa_div10(vr);
+				vrMod = (uint32_t)vr - 10 * (uint32_t)vrDiv;
+				vrIsTrailingZeros &= lastRemovedDigit == 0;
+				lastRemovedDigit = vrMod;
+				vr = vrDiv;
+				vp = vpDiv;
+				vm = vmDiv;
+				++removed;
+			}
+		}
+
+		/* Round half to even */
+		if (vrIsTrailingZeros && (lastRemovedDigit == 5) && ((vr & 1) == 0))
+			lastRemovedDigit = 4;
+
+		output = vr + (((vr == vm) && (!even || !vmIsTrailingZeros)) || (lastRemovedDigit >= 5));
+	}
+	else {
+		vpDiv = dtoa_div100(vp);
+		vmDiv = dtoa_div100(vm);
+		if (vpDiv > vmDiv) {
+			vrDiv = dtoa_div100(vr);
+			roundUp = (uint32_t)vr - 100 * (uint32_t)vrDiv >= 50;
+			vr = vrDiv;
+			vp = vpDiv;
+			vm = vmDiv;
+			removed += 2;
+		}
+
+		for (;;) {
+			vpDiv = dtoa_div10(vp);
+			vmDiv = dtoa_div10(vm);
+			if (vpDiv <= vmDiv)
+				break;
+			vrDiv = dtoa_div10(vr);
+			roundUp = (uint32_t)vr - 10 * (uint32_t)vrDiv >= 5;
+			vr = vrDiv;
+			vp = vpDiv;
+			vm = vmDiv;
+			++removed;
+		}
+
+		output = vr + ((vr == vm) || roundUp);
+	}
+
+	*exp = e10 + removed;
+
+	return output;
+}
+
+
+size_t dtoa_shortest(double value, char *buf)
+{
+	union {
+		double d;
+		uint64_t u;
+	} bits = { .d = value };
+	uint64_t mantissa = bits.u & ((1ull << DOUBLE_MANTISSA_BITS) - 1), output;
+	uint32_t exponent = (uint32_t)(bits.u >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1);
+	char digits[UTOA_DEC64_MAX], *end = digits + sizeof(digits), *start, *p = buf;
+	int32_t exp, olength, x;
+
+	if ((exponent == (1u << DOUBLE_EXPONENT_BITS) - 1) && (mantissa != 0)) {
+		memcpy(buf, "nan", 4);
+		return 3;
+	}
+
+	if ((bits.u >> 63) != 0)
+		*p++ = '-';
+
+	if (exponent == (1u << DOUBLE_EXPONENT_BITS) - 1) {
+		memcpy(p, "inf", 4);
+		return p + 3 - buf;
+	}
+
+	if ((exponent == 0) && (mantissa == 0)) {
+		memcpy(p, "0", 2);
+		return p + 1 - buf;
+	}
+
+	output = dtoa_d2d(mantissa, exponent, &exp);
+	start = __utoa_dec64(output, end);
+	olength = end - start;
+
+	/* Decimal exponent of the leading digit, notation is chosen as by %.17g */
+	x = exp + olength - 1;
+
+	if ((x < -4) || (x >= 17)) {
+		*p++ = *start++;
+		if (start != end) {
+			*p++ = '.';
+			memcpy(p, start, end - start);
+			p += end - start;
+		}
+		*p++ = 'e';
+		*p++ = (x < 0) ? '-' : '+';
+		x = (x < 0) ? -x : x;
+		if (x < 10)
+			*p++ = '0';
+		p += lib_utoa(x, p);
+		return p - buf;
+	}
+
+	if (x < 0) {
+		memcpy(p, "0.0000", 1 - x);
+		p += 1 - x;
+		memcpy(p, start, olength);
+		p += olength;
+	}
+	else if (x >= olength - 1) {
+		memcpy(p, start, olength);
+		p += olength;
+		memset(p, '0', x - olength + 1);
+		p += x - olength + 1;
+	}
+	else {
+		memcpy(p, start, x + 1);
+		p += x + 1;
+		*p++ = '.';
+		memcpy(p, start + x + 1, olength - x - 1);
+		p += olength - x - 1;
+	}
+	*p = '\0';
+
+	return p - buf;
+}
@@ -0,0 +1,22 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Architecture dependent definitions for allocators built on host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_HOST_ARCH_H_
+#define _LIBPHOENIX_HOST_ARCH_H_
+
+#define _PAGE_SIZE 0x1000
+
+#define __LIBPHOENIX_ARCH_TLS_SUPPORTED
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Floating point conversion test run on host, checks dtoa_shortest and format_parse
+ * against host libc
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+/*
+ * Random doubles have to read back from dtoa_shortest with the fewest digits which do
+ * so, and %f/%e/%g with random flags, width and precision have to match host snprintf.
+ *
+ * Usage: dtoa-test [-n count] [-s seed]
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../stdio/format.h"
+
+
+#define TEST_BUFSZ    1024
+#define TEST_FAILMAX  10
+
+
+typedef struct {
+	char *buff;
+	size_t n;
+} test_ctx_t;
+
+
+static struct {
+	uint64_t state;
+	unsigned int failed;
+} test_common;
+
+
+static const double test_specials[] = {
+	0.0, -0.0, 1.0, -1.0, 0.5, 1.5, 2.5, 9.5, 0.05, 0.15, 0.25, 0.35, 1e-5, 1e-4, 123456.0, 999999.5,
+	9.9999999999999995e-5, 1e15, 1e16, 1e17, 9007199254740993.0, 1e21, 1e22, 1e23, 5e-324, 2.2250738585072009e-308,
+	DBL_MIN, DBL_MAX, DBL_EPSILON, M_PI, 1.0 / 3.0, 2.0 / 3.0, 0.1, 0.2, 0.3, 299792458.0, INFINITY, -INFINITY
+};
+
+
+static const char *test_flags[] = { "", "#", "+", " ", "-", "0", "+0", "#-" };
+
+
+static uint64_t test_rand(void)
+{
+	test_common.state ^= test_common.state >> 12;
+	test_common.state ^= test_common.state << 25;
+	test_common.state ^= test_common.state >> 27;
+
+	return test_common.state * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* Half of the values are arbitrary bit patterns, the rest have few decimal digits to hit ties in rounding */
+static double test_double(void)
+{
+	union {
+		double d;
+		uint64_t u;
+	} bits;
+	uint64_t r = test_rand();
+
+	if ((r & 1) != 0) {
+		do {
+			bits.u = test_rand();
+		} while (isnan(bits.d) || isinf(bits.d));
+
+		return bits.d;
+	}
+
+	bits.d = (double)(test_rand() % 1000000) / pow(10, (int)((r >> 1) % 40) - 20);
+
+	return ((r & 2) != 0) ? -bits.d : bits.d;
+}
+
+
+static void test_fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (test_common.failed++ < TEST_FAILMAX) {
+		va_start(ap, fmt);
+		fputs("dtoa-test: ", stderr);
+		vfprintf(stderr, fmt, ap);
+		fputc('\n', stderr);
+		va_end(ap);
+	}
+}
+
+
+static int test_feed(void *context, const char *str, size_t len, char fill)
+{
+	test_ctx_t *ctx = (test_ctx_t *)context;
+
+	if (ctx->n + len >= TEST_BUFSZ)
+		return -1;
+
+	if (str != NULL)
+		memcpy(ctx->buff + ctx->n, str, len);
+	else
+		memset(ctx->buff + ctx->n, fill, len);
+	ctx->n += len;
+
+	return 0;
+}
+
+
+static int test_format(char *buff, const char *fmt, ...)
+{
+	test_ctx_t ctx = { buff, 0 };
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = format_parse(&ctx, test_feed, fmt, ap);
+	va_end(ap);
+
+	buff[ctx.n] = '\0';
+
+	return (ret < 0) ? ret : (int)ctx.n;
+}
+
+
+/* Significant digits of a %e or %f like string */
+static int test_digits(const char *s)
+{
+	const char *first = NULL, *last = NULL;
+	int n = 0;
+
+	for (; (*s != '\0') && (*s != 'e'); ++s) {
+		if ((*s < '0') || (*s > '9'))
+			continue;
+		if ((first == NULL) && (*s == '0'))
+			continue;
+		if (first == NULL)
+			first = s;
+		if (*s != '0')
+			last = s;
+	}
+
+	for (s = first; (s != NULL) && (s <= last); ++s)
+		n += (*s >= '0') && (*s <= '9');
+
+	return n;
+}
+
+
+static void test_shortest(double d)
+{
+	char buf[32], ref[32];
+	size_t len;
+	int prec;
+
+	len = dtoa_shortest(d, buf);
+	if ((len != strlen(buf)) || (len >= 25)) {
+		test_fail("dtoa_shortest(%a) gives length %zu for \"%s\"", d, len, buf);
+		return;
+	}
+
+	if (memcmp(&d, &(double) { strtod(buf, NULL) }, sizeof(d)) != 0) {
+		test_fail("dtoa_shortest(%a) gives \"%s\", which does not read back", d, buf);
+		return;
+	}
+
+	if ((d == 0) || isinf(d))
+		return;
+
+	for (prec = 1; prec < 17; ++prec) {
+		snprintf(ref, sizeof(ref), "%.*e", prec - 1, d);
+		if (strtod(ref, NULL) == d)
+			break;
+	}
+
+	if (test_digits(buf) > prec)
+		test_fail("dtoa_shortest(%a) gives \"%s\", \"%s\" is shorter", d, buf, ref);
+}
+
+
+static void test_conv(double d, const char *flags, int width, int prec, char conv)
+{
+	char fmt[32], reffmt[32], buf[TEST_BUFSZ], ref[TEST_BUFSZ];
+	int len, reflen, p, x;
+
+	if (prec < 0)
+		sprintf(fmt, "%%%s%.0d%c", flags, width, conv);
+	else
+		sprintf(fmt, "%%%s%.0d.%d%c", flags, width, prec, conv);
+
+	strcpy(reffmt, fmt);
+
+	/* Host libc drops the zeros of %#g when rounding carries into the next decade (999999.5 gives "1.e+06"),
+	 * the reference is made with %e or %f then (conv - 2 and conv - 1), as C99 7.19.6.1 defines %g */
+	if (((conv == 'g') || (conv == 'G')) && (strchr(flags, '#') != NULL) && isfinite(d)) {
+		p = (prec < 0) ? 6 : ((prec == 0) ? 1 : prec);
+		snprintf(ref, sizeof(ref), "%.*e", p - 1, d);
+		x = atoi(strchr(ref, 'e') + 1);
+
+		if ((p > x) && (x >= -4))
+			sprintf(reffmt, "%%%s%.0d.%d%c", flags, width, p - 1 - x, conv - 1);
+		else
+			sprintf(reffmt, "%%%s%.0d.%d%c", flags, width, p - 1, conv - 2);
+	}
+
+	len = test_format(buf, fmt, d);
+	reflen = snprintf(ref, sizeof(ref), reffmt, d);
+
+	if ((len != reflen) || (strcmp(buf, ref) != 0))
+		test_fail("\"%s\" of %a gives \"%s\", expected \"%s\"", fmt, d, buf, ref);
+}
+
+
+static void test_all(double d)
+{
+	static const char convs[] = "feEgG";
+	unsigned int f, c;
+	int prec;
+
+	test_shortest(d);
+
+	for (c = 0; c < sizeof(convs) - 1; ++c) {
+		for (prec = -1; prec <= 20; ++prec) {
+			for (f = 0; f < sizeof(test_flags) / sizeof(test_flags[0]); ++f)
+				test_conv(d, test_flags[f], (f & 1) ? 30 : 0, prec, convs[c]);
+		}
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	static const char convs[] = "feg";
+	unsigned long i, count = 400000;
+	uint64_t r;
+	double d;
+	int c;
+
+	test_common.state = 1;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+			case 'n':
+				count = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				test_common.state = strtoull(optarg, NULL, 0) | 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n count] [-s seed]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < sizeof(test_specials) / sizeof(test_specials[0]); ++i) {
+		test_all(test_specials[i]);
+		test_all(nextafter(test_specials[i], 0));
+	}
+
+	for (i = 0; i < count; ++i) {
+		d = test_double();
+		test_shortest(d);
+
+		/* One conversion of each kind with random flags, width and precision */
+		for (c = 0; c < 3; ++c) {
+			r = test_rand();
+			test_conv(d, test_flags[r % 8], ((r >> 3) & 1) ? (int)((r >> 4) % 40) : 0, (int)((r >> 10) % 22) - 1, convs[c]);
+		}
+	}
+
+	if (test_common.failed != 0) {
+		fprintf(stderr, "dtoa-test: %u failures\n", test_common.failed);
+		return EXIT_FAILURE;
+	}
+
+	printf("dtoa-test: %lu values ok\n", count);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,771 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Allocator benchmark and stress suite run on host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+/*
+ * Every benchmark prints one tab separated table with a header row, tables are separated by
+ * an empty line. Each allocator runs in a forked process, so that it starts from a fresh state
+ * and its footprint can be taken from the process RSS.
+ *
+ * Usage: malloc-bench [-a dl,tlsf,t3,libc] [-t threads] [-n scale] [benchmark...]
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+#define BENCH_ALLOC_DECLARE(p) \
+	extern void p##malloc_init(void); \
+	extern void p##malloc_threadCleanup(void); \
+	extern void *p##malloc(size_t size); \
+	extern void p##free(void *ptr); \
+	extern void *p##realloc(void *ptr, size_t size);
+
+BENCH_ALLOC_DECLARE(dl_)
+BENCH_ALLOC_DECLARE(tlsf_)
+BENCH_ALLOC_DECLARE(t3_)
+
+
+#define BENCH_THREADS_MAX 64
+
+
+typedef struct {
+	const char *name;
+	void (*init)(void);
+	void (*threadCleanup)(void);
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+} bench_alloc_t;
+
+
+typedef struct {
+	const char *name;
+	const char *header;
+	void (*run)(const bench_alloc_t *alloc);
+} bench_t;
+
+
+typedef struct _bench_thread_t {
+	const bench_alloc_t *alloc;
+	void (*fn)(struct _bench_thread_t *thread);
+	pthread_t tid;
+	unsigned int id;
+	unsigned int nthreads;
+	uint64_t rng;
+	void *arg;
+	double elapsed;
+	size_t ops;
+} bench_thread_t;
+
+
+static const bench_alloc_t bench_allocs[] = {
+	{ "dl", dl_malloc_init, dl_malloc_threadCleanup, dl_malloc, dl_free, dl_realloc },
+	{ "tlsf", tlsf_malloc_init, tlsf_malloc_threadCleanup, tlsf_malloc, tlsf_free, tlsf_realloc },
+	{ "t3", t3_malloc_init, t3_malloc_threadCleanup, t3_malloc, t3_free, t3_realloc },
+	{ "libc", NULL, NULL, malloc, free, realloc },
+};
+
+
+static struct {
+	unsigned int nthreads;
+	unsigned int scale;
+	pthread_barrier_t barrier;
+} bench_common;
+
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* xorshift64*, each thread keeps its own state so that runs are repeatable */
+static uint64_t bench_rand(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* Sizes skewed towards small objects, as seen in most programs */
+static size_t bench_size(uint64_t *state, size_t min, size_t max)
+{
+	uint64_t r = bench_rand(state);
+	size_t span = max - min + 1;
+
+	if ((r & 3) != 0)
+		span = (span >> 4) + 1;
+
+	return min + (size_t)((r >> 8) % span);
+}
+
+
+static size_t bench_rss(void)
+{
+	unsigned long size, rss = 0;
+	FILE *f;
+
+	if ((f = fopen("/proc/self/statm", "r")) != NULL) {
+		if (fscanf(f, "%lu %lu", &size, &rss) != 2)
+			rss = 0;
+		fclose(f);
+	}
+
+	return rss * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+
+/* Touches the memory, so that it counts in RSS and the allocator can't get away with lazy mappings */
+static void bench_touch(void *ptr, size_t size)
+{
+	volatile char *p = ptr;
+	size_t i;
+
+	for (i = 0; i < size; i += 4096)
+		p[i] = (char)i;
+	p[size - 1] = 1;
+}
+
+
+static void *bench_threadMain(void *arg)
+{
+	bench_thread_t *thread = arg;
+	double start;
+
+	pthread_barrier_wait(&bench_common.barrier);
+
+	start = bench_now();
+	thread->fn(thread);
+	thread->elapsed = bench_now() - start;
+
+	if (thread->alloc->threadCleanup != NULL)
+		thread->alloc->threadCleanup();
+
+	return NULL;
+}
+
+
+/* Runs fn in n threads started together, returns the wall time of the slowest one */
+static double bench_threads(const bench_alloc_t *alloc, unsigned int n, void (*fn)(bench_thread_t *), void **args, size_t *ops)
+{
+	bench_thread_t threads[BENCH_THREADS_MAX];
+	double elapsed = 0;
+	unsigned int i;
+
+	pthread_barrier_init(&bench_common.barrier, NULL, n);
+
+	for (i = 0; i < n; ++i) {
+		threads[i].alloc = alloc;
+		threads[i].fn = fn;
+		threads[i].id = i;
+		threads[i].nthreads = n;
+		threads[i].rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+		threads[i].arg = (args != NULL) ? args[i] : NULL;
+		threads[i].ops = 0;
+
+		if (pthread_create(&threads[i].tid, NULL, bench_threadMain, &threads[i]) != 0) {
+			fprintf(stderr, "malloc-bench: pthread_create failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	*ops = 0;
+	for (i = 0; i < n; ++i) {
+		pthread_join(threads[i].tid, NULL);
+		if (threads[i].elapsed > elapsed)
+			elapsed = threads[i].elapsed;
+		*ops += threads[i].ops;
+	}
+
+	pthread_barrier_destroy(&bench_common.barrier);
+
+	return elapsed;
+}
+
+
+/* Size class sweep: batches of same-sized objects allocated and freed in LIFO order */
+
+static const size_t bench_sweepSizes[] = { 16, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536, 262144 };
+
+
+static void bench_sweepThread(bench_thread_t *thread)
+{
+	size_t size = *(size_t *)thread->arg, rounds, i, j;
+	void *ptrs[64];
+
+	rounds = (20000 * bench_common.scale) / (1 + size / 1024);
+
+	for (i = 0; i < rounds; ++i) {
+		for (j = 0; j < 64; ++j) {
+			ptrs[j] = thread->alloc->malloc(size);
+			*(volatile char *)ptrs[j] = 0;
+		}
+
+		for (j = 64; j-- > 0;)
+			thread->alloc->free(ptrs[j]);
+	}
+
+	thread->ops = rounds * 64;
+}
+
+
+static void bench_sweep(const bench_alloc_t *alloc)
+{
+	void *args[BENCH_THREADS_MAX];
+	unsigned int n, i, k;
+	double elapsed;
+	size_t ops;
+
+	for (k = 0; k < sizeof(bench_sweepSizes) / sizeof(bench_sweepSizes[0]); ++k) {
+		for (i = 0; i < BENCH_THREADS_MAX; ++i)
+			args[i] = (void *)&bench_sweepSizes[k];
+
+		for (n = 1; n <= bench_common.nthreads; n = (n < bench_common.nthreads) ? bench_common.nthreads : n + 1) {
+			elapsed = bench_threads(alloc, n, bench_sweepThread, args, &ops);
+			printf("%s\t%u\t%zu\t%zu\t%.1f\t%.0f\n", alloc->name, n, bench_sweepSizes[k], ops, elapsed * 1e9 * n / ops, ops / elapsed);
+		}
+	}
+}
+
+
+/*
+ * Larson churn: threads free and allocate random slots of their array, after each round
+ * the arrays are passed to the next thread, so that objects are freed by other threads.
+ */
+
+#define BENCH_LARSON_SLOTS  1000
+#define BENCH_LARSON_ROUNDS 10
+
+
+static void bench_larsonThread(bench_thread_t *thread)
+{
+	void **slots = thread->arg;
+	size_t i, idx, size, n = 10000 * bench_common.scale;
+
+	for (i = 0; i < n; ++i) {
+		idx = bench_rand(&thread->rng) % BENCH_LARSON_SLOTS;
+		size = bench_size(&thread->rng, 8, 1024);
+
+		thread->alloc->free(slots[idx]);
+		slots[idx] = thread->alloc->malloc(size);
+		*(volatile char *)slots[idx] = 0;
+	}
+
+	thread->ops = n;
+}
+
+
+static void bench_larson(const bench_alloc_t *alloc)
+{
+	void *args[BENCH_THREADS_MAX], *first;
+	unsigned int n, i, r;
+	double elapsed;
+	size_t ops, total;
+	uint64_t rng = 1;
+
+	for (n = 1; n <= bench_common.nthreads; n = (n < bench_common.nthreads) ? bench_common.nthreads : n + 1) {
+		for (i = 0; i < n; ++i) {
+			args[i] = alloc->malloc(BENCH_LARSON_SLOTS * sizeof(void *));
+			for (r = 0; r < BENCH_LARSON_SLOTS; ++r)
+				((void **)args[i])[r] = alloc->malloc(bench_size(&rng, 8, 1024));
+		}
+
+		elapsed = 0;
+		total = 0;
+		for (r = 0; r < BENCH_LARSON_ROUNDS; ++r) {
+			elapsed += bench_threads(alloc, n, bench_larsonThread, args, &ops);
+			total += ops;
+
+			first = args[0];
+			for (i = 1; i < n; ++i)
+				args[i - 1] = args[i];
+			args[n - 1] = first;
+		}
+
+		for (i = 0; i < n; ++i) {
+			for (r = 0; r < BENCH_LARSON_SLOTS; ++r)
+				alloc->free(((void **)args[i])[r]);
+			alloc->free(args[i]);
+		}
+
+		printf("%s\t%u\t%zu\t%.1f\t%.0f\n", alloc->name, n, total, elapsed * 1e9 * n / total, total / elapsed);
+	}
+}
+
+
+/* Realloc growth: a buffer grown step by step, alone and with small allocations in between */
+
+static void bench_reallocRun(const bench_alloc_t *alloc, const char *pattern, size_t step, int doubling, int interleave)
+{
+	size_t size = 16, max = 4 * 1024 * 1024, n = 0, moves = 0, i, nsmall = 0;
+	void **small = NULL, *ptr = NULL, *prev;
+	double start, elapsed;
+	unsigned int round;
+
+	if (interleave) {
+		small = alloc->malloc((doubling ? 64 : max / step + 1) * sizeof(void *));
+	}
+
+	start = bench_now();
+	for (round = 0; round < bench_common.scale; ++round) {
+		for (size = 16; size <= max; size = doubling ? size * 2 : size + step) {
+			prev = ptr;
+			if ((ptr = alloc->realloc(ptr, size)) == NULL) {
+				fprintf(stderr, "malloc-bench: realloc(%zu) failed\n", size);
+				exit(EXIT_FAILURE);
+			}
+			((volatile char *)ptr)[size - 1] = 0;
+
+			moves += (prev != ptr);
+			n++;
+
+			if (interleave)
+				small[nsmall++] = alloc->malloc(32);
+		}
+
+		alloc->free(ptr);
+		ptr = NULL;
+
+		for (i = 0; i < nsmall; ++i)
+			alloc->free(small[i]);
+		nsmall = 0;
+	}
+	elapsed = bench_now() - start;
+
+	alloc->free(small);
+
+	printf("%s\t%s\t%zu\t%zu\t%.1f\n", alloc->name, pattern, n, moves, elapsed * 1e9 / n);
+}
+
+
+static void bench_realloc(const bench_alloc_t *alloc)
+{
+	bench_reallocRun(alloc, "linear", 4096, 0, 0);
+	bench_reallocRun(alloc, "linear-interleaved", 4096, 0, 1);
+	bench_reallocRun(alloc, "doubling", 0, 1, 0);
+	bench_reallocRun(alloc, "doubling-interleaved", 0, 1, 1);
+}
+
+
+/*
+ * Fragmentation over time: a live set of random sized objects is replaced at random, the
+ * footprint is sampled against the live bytes. Most objects are freed at the end, so that
+ * the last rows show how much memory the allocator keeps for the survivors.
+ */
+
+#define BENCH_FRAG_SLOTS 32768
+#define BENCH_FRAG_STEPS 10
+
+
+static void bench_fragRow(const bench_alloc_t *alloc, const char *phase, unsigned int step, size_t live, size_t base)
+{
+	size_t rss = bench_rss() - base;
+
+	printf("%s\t%s\t%u\t%zu\t%zu\t%.2f\n", alloc->name, phase, step, live / 1024, rss / 1024, (live != 0) ? (double)rss / live : 0.0);
+}
+
+
+static void bench_frag(const bench_alloc_t *alloc)
+{
+	static void *slots[BENCH_FRAG_SLOTS];
+	static size_t sizes[BENCH_FRAG_SLOTS];
+	size_t base, live = 0, i, idx, n;
+	uint64_t rng = 7;
+	unsigned int step;
+
+	base = bench_rss();
+
+	for (i = 0; i < BENCH_FRAG_SLOTS; ++i) {
+		sizes[i] = bench_size(&rng, 16, 16384);
+		slots[i] = alloc->malloc(sizes[i]);
+		bench_touch(slots[i], sizes[i]);
+		live += sizes[i];
+	}
+	bench_fragRow(alloc, "fill", 0, live, base);
+
+	n = (size_t)BENCH_FRAG_SLOTS * bench_common.scale;
+	for (step = 1; step <= BENCH_FRAG_STEPS; ++step) {
+		for (i = 0; i < n; ++i) {
+			idx = bench_rand(&rng) % BENCH_FRAG_SLOTS;
+			alloc->free(slots[idx]);
+			live -= sizes[idx];
+
+			/* Object sizes drift, so that freed chunks don't simply fit the next request */
+			sizes[idx] = bench_size(&rng, 16, 16384 + step * 1024);
+			slots[idx] = alloc->malloc(sizes[idx]);
+			bench_touch(slots[idx], sizes[idx]);
+			live += sizes[idx];
+		}
+		bench_fragRow(alloc, "churn", step, live, base);
+	}
+
+	for (i = 0; i < BENCH_FRAG_SLOTS; ++i) {
+		if ((i % 16) != 0) {
+			alloc->free(slots[i]);
+			live -= sizes[i];
+			slots[i] = NULL;
+		}
+	}
+	bench_fragRow(alloc, "drain", 0, live, base);
+
+	for (i = 0; i < BENCH_FRAG_SLOTS; i += 16)
+		alloc->free(slots[i]);
+}
+
+
+/* Contention: every thread churns its own window of objects, thread count goes from 1 to N */
+
+#define BENCH_CONTENTION_WINDOW 256
+
+
+static void bench_contentionThread(bench_thread_t *thread)
+{
+	void *window[BENCH_CONTENTION_WINDOW] = { NULL };
+	size_t i, idx, n = 100000 * bench_common.scale;
+
+	for (i = 0; i < n; ++i) {
+		idx = bench_rand(&thread->rng) % BENCH_CONTENTION_WINDOW;
+
+		thread->alloc->free(window[idx]);
+		window[idx] = thread->alloc->malloc(bench_size(&thread->rng, 16, 2048));
+		*(volatile char *)window[idx] = 0;
+	}
+
+	for (i = 0; i < BENCH_CONTENTION_WINDOW; ++i)
+		thread->alloc->free(window[i]);
+
+	thread->ops = n;
+}
+
+
+static void bench_contention(const bench_alloc_t *alloc)
+{
+	double elapsed, base = 0;
+	unsigned int n;
+	size_t ops;
+
+	for (n = 1; n <= bench_common.nthreads; ++n) {
+		elapsed = bench_threads(alloc, n, bench_contentionThread, NULL, &ops);
+		if (n == 1)
+			base = ops / elapsed;
+
+		printf("%s\t%u\t%zu\t%.1f\t%.0f\t%.2f\n", alloc->name, n, ops, elapsed * 1e9 * n / ops, ops / elapsed, ops / elapsed / base);
+	}
+}
+
+
+/* Producer/consumer: pairs of threads, objects allocated by one are passed through a ring and freed by the other */
+
+#define BENCH_RING_SIZE 256
+
+
+typedef struct {
+	_Atomic size_t head __attribute__((aligned(64)));
+	_Atomic size_t tail __attribute__((aligned(64)));
+	void *slots[BENCH_RING_SIZE];
+} bench_ring_t;
+
+
+static void bench_pairThread(bench_thread_t *thread)
+{
+	bench_ring_t *ring = thread->arg;
+	size_t i, pos, n = 100000 * bench_common.scale;
+	void *ptr;
+
+	for (i = 0; i < n; ++i) {
+		if ((thread->id & 1) == 0) {
+			ptr = thread->alloc->malloc(bench_size(&thread->rng, 16, 1024));
+			*(volatile char *)ptr = 0;
+
+			pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+			while (pos - atomic_load_explicit(&ring->tail, memory_order_acquire) == BENCH_RING_SIZE)
+				sched_yield();
+
+			ring->slots[pos % BENCH_RING_SIZE] = ptr;
+			atomic_store_explicit(&ring->head, pos + 1, memory_order_release);
+		}
+		else {
+			pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+			while (pos == atomic_load_explicit(&ring->head, memory_order_acquire))
+				sched_yield();
+
+			thread->alloc->free(ring->slots[pos % BENCH_RING_SIZE]);
+			atomic_store_explicit(&ring->tail, pos + 1, memory_order_release);
+		}
+	}
+
+	thread->ops = ((thread->id & 1) == 0) ? n : 0;
+}
+
+
+static void bench_pairs(const bench_alloc_t *alloc)
+{
+	static bench_ring_t rings[BENCH_THREADS_MAX / 2];
+	void *args[BENCH_THREADS_MAX];
+	unsigned int n, i, max = (bench_common.nthreads > 1) ? bench_common.nthreads / 2 : 1;
+	double elapsed;
+	size_t ops;
+
+	for (n = 1; n <= max; n = (n < max) ? max : n + 1) {
+		for (i = 0; i < n; ++i) {
+			atomic_init(&rings[i].head, 0);
+			atomic_init(&rings[i].tail, 0);
+			args[2 * i] = &rings[i];
+			args[2 * i + 1] = &rings[i];
+		}
+
+		elapsed = bench_threads(alloc, 2 * n, bench_pairThread, args, &ops);
+		printf("%s\t%u\t%zu\t%.1f\t%.0f\n", alloc->name, n, ops, elapsed * 1e9 * n / ops, ops / elapsed);
+	}
+}
+
+
+/*
+ * Latency: every malloc and free of a random live set is timed on its own, the table shows
+ * the tail of the distribution, which matters for real-time threads more than the throughput.
+ */
+
+#define BENCH_LATENCY_WINDOW 1024
+
+
+static uint64_t bench_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static int bench_latencyCmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+static void bench_latencyThread(bench_thread_t *thread)
+{
+	void *window[BENCH_LATENCY_WINDOW] = { NULL };
+	uint32_t *samples = thread->arg, *frees = samples + 100000 * bench_common.scale;
+	size_t i, idx, size, n = 100000 * bench_common.scale;
+	uint64_t t0, t1, t2;
+
+	for (i = 0; i < n; ++i) {
+		idx = bench_rand(&thread->rng) % BENCH_LATENCY_WINDOW;
+		size = bench_size(&thread->rng, 16, 65536);
+
+		t0 = bench_nsec();
+		thread->alloc->free(window[idx]);
+		t1 = bench_nsec();
+		window[idx] = thread->alloc->malloc(size);
+		t2 = bench_nsec();
+
+		*(volatile char *)window[idx] = 0;
+		frees[i] = (uint32_t)(t1 - t0);
+		samples[i] = (uint32_t)(t2 - t1);
+	}
+
+	for (i = 0; i < BENCH_LATENCY_WINDOW; ++i)
+		thread->alloc->free(window[i]);
+
+	thread->ops = n;
+}
+
+
+static void bench_latencyRow(const bench_alloc_t *alloc, const char *op, unsigned int threads, uint32_t *samples, size_t n)
+{
+	qsort(samples, n, sizeof(*samples), bench_latencyCmp);
+
+	printf("%s\t%s\t%u\t%zu\t%u\t%u\t%u\t%u\n", alloc->name, op, threads, n,
+		samples[n / 2], samples[n - 1 - n / 100], samples[n - 1 - n / 1000], samples[n - 1]);
+}
+
+
+static void bench_latency(const bench_alloc_t *alloc)
+{
+	size_t i, ops, per = 100000 * bench_common.scale;
+	void *args[BENCH_THREADS_MAX];
+	uint32_t *samples, *frees;
+	unsigned int n;
+
+	/* Samples are kept outside of the measured allocator */
+	samples = malloc(bench_common.nthreads * 2 * per * sizeof(*samples));
+	frees = malloc(bench_common.nthreads * per * sizeof(*frees));
+	if ((samples == NULL) || (frees == NULL)) {
+		fprintf(stderr, "malloc-bench: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (n = 1; n <= bench_common.nthreads; n = (n < bench_common.nthreads) ? bench_common.nthreads : n + 1) {
+		for (i = 0; i < n; ++i)
+			args[i] = samples + i * 2 * per;
+
+		bench_threads(alloc, n, bench_latencyThread, args, &ops);
+
+		/* Gather mallocs to the front and frees aside, each thread wrote both halves of its part */
+		for (i = 0; i < n; ++i) {
+			memcpy(frees + i * per, samples + i * 2 * per + per, per * sizeof(*samples));
+			memmove(samples + i * per, samples + i * 2 * per, per * sizeof(*samples));
+		}
+
+		bench_latencyRow(alloc, "malloc", n, samples, ops);
+		bench_latencyRow(alloc, "free", n, frees, ops);
+	}
+
+	free(frees);
+	free(samples);
+}
+
+
+static const bench_t benches[] = {
+	{ "sweep", "alloc\tthreads\tsize\tops\tns_per_op\tops_per_s", bench_sweep },
+	{ "larson", "alloc\tthreads\tops\tns_per_op\tops_per_s", bench_larson },
+	{ "realloc", "alloc\tpattern\treallocs\tmoves\tns_per_realloc", bench_realloc },
+	{ "frag", "alloc\tphase\tstep\tlive_kb\tfootprint_kb\tratio", bench_frag },
+	{ "contention", "alloc\tthreads\tops\tns_per_op\tops_per_s\tspeedup", bench_contention },
+	{ "pairs", "alloc\tpairs\tobjects\tns_per_object\tobjects_per_s", bench_pairs },
+	{ "latency", "alloc\top\tthreads\tsamples\tp50_ns\tp99_ns\tp99.9_ns\tmax_ns", bench_latency },
+};
+
+
+static int bench_selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = list;
+
+	if (list == NULL)
+		return 1;
+
+	while ((p = strstr(p, name)) != NULL) {
+		if (((p == list) || (p[-1] == ',')) && ((p[len] == '\0') || (p[len] == ',')))
+			return 1;
+		p += len;
+	}
+
+	return 0;
+}
+
+
+static void bench_run(const bench_t *bench, const char *allocs)
+{
+	unsigned int i;
+	pid_t pid;
+	int status;
+
+	printf("# %s\n%s\n", bench->name, bench->header);
+	fflush(stdout);
+
+	for (i = 0; i < sizeof(bench_allocs) / sizeof(bench_allocs[0]); ++i) {
+		if (!bench_selected(allocs, bench_allocs[i].name))
+			continue;
+
+		if ((pid = fork()) < 0) {
+			perror("malloc-bench: fork");
+			exit(EXIT_FAILURE);
+		}
+
+		if (pid == 0) {
+			if (bench_allocs[i].init != NULL)
+				bench_allocs[i].init();
+
+			bench->run(&bench_allocs[i]);
+			fflush(stdout);
+			_exit(EXIT_SUCCESS);
+		}
+
+		if ((waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+			fprintf(stderr, "malloc-bench: %s failed for %s\n", bench->name, bench_allocs[i].name);
+	}
+
+	printf("\n");
+	fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *allocs = NULL;
+	unsigned int i;
+	long ncpu;
+	int c, ran = 0, j;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	bench_common.nthreads = (ncpu > 1) ? ((ncpu < 8) ? ncpu : 8) : 2;
+	bench_common.scale = 1;
+
+	while ((c = getopt(argc, argv, "a:t:n:h")) != -1) {
+		switch (c) {
+			case 'a':
+				allocs = optarg;
+				break;
+
+			case 't':
+				bench_common.nthreads = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'n':
+				bench_common.scale = strtoul(optarg, NULL, 10);
+				break;
+
+			default:
+				fprintf(stderr, "Usage: %s [-a dl,tlsf,t3,libc] [-t threads] [-n scale] [benchmark...]\nBenchmarks:", argv[0]);
+				for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i)
+					fprintf(stderr, " %s", benches[i].name);
+				fprintf(stderr, "\n");
+				return (c == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if ((bench_common.nthreads == 0) || (bench_common.nthreads > BENCH_THREADS_MAX) || (bench_common.scale == 0)) {
+		fprintf(stderr, "malloc-bench: threads have to be in 1..%d, scale above 0\n", BENCH_THREADS_MAX);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+		for (j = optind; j < argc; ++j) {
+			if (strcmp(argv[j], benches[i].name) == 0)
+				break;
+		}
+
+		if ((optind == argc) || (j < argc)) {
+			bench_run(&benches[i], allocs);
+			ran++;
+		}
+	}
+
+	if (ran == 0) {
+		fprintf(stderr, "malloc-bench: no such benchmark\n");
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Renames allocator entry points for host builds, included before the allocator source
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_HOST_MALLOC_HOST_H_
+#define _LIBPHOENIX_HOST_MALLOC_HOST_H_
+
+/*
+ * Host libc keeps its own allocator, entry points get MALLOC_HOST_PREFIX (e.g. dl_malloc),
+ * so that several allocators can be linked into one program and compared.
+ */
+#ifndef MALLOC_HOST_PREFIX
+#error "MALLOC_HOST_PREFIX not defined"
+#endif
+
+#define MALLOC_HOST_CAT2(prefix, name) prefix##name
+#define MALLOC_HOST_CAT(prefix, name)  MALLOC_HOST_CAT2(prefix, name)
+#define MALLOC_HOST_NAME(name)         MALLOC_HOST_CAT(MALLOC_HOST_PREFIX, name)
+
+#define malloc                 MALLOC_HOST_NAME(malloc)
+#define calloc                 MALLOC_HOST_NAME(calloc)
+#define realloc                MALLOC_HOST_NAME(realloc)
+#define free                   MALLOC_HOST_NAME(free)
+#define free_sized             MALLOC_HOST_NAME(free_sized)
+#define free_aligned_sized     MALLOC_HOST_NAME(free_aligned_sized)
+#define free_batch             MALLOC_HOST_NAME(free_batch)
+#define malloc_usable_size     MALLOC_HOST_NAME(malloc_usable_size)
+#define posix_memalign         MALLOC_HOST_NAME(posix_memalign)
+#define aligned_alloc          MALLOC_HOST_NAME(aligned_alloc)
+#define memalign               MALLOC_HOST_NAME(memalign)
+#define malloc_trim            MALLOC_HOST_NAME(malloc_trim)
+#define mallopt                MALLOC_HOST_NAME(mallopt)
+#define mallinfo2              MALLOC_HOST_NAME(mallinfo2)
+#define malloc_stats           MALLOC_HOST_NAME(malloc_stats)
+#define malloc_info            MALLOC_HOST_NAME(malloc_info)
+#define malloc_profile         MALLOC_HOST_NAME(malloc_profile)
+#define malloc_profileRead     MALLOC_HOST_NAME(malloc_profileRead)
+#define malloc_profileDump     MALLOC_HOST_NAME(malloc_profileDump)
+#define malloc_test            MALLOC_HOST_NAME(malloc_test)
+#define malloc_common          MALLOC_HOST_NAME(malloc_common)
+#define _malloc_init           MALLOC_HOST_NAME(malloc_init)
+#define _malloc_threadCleanup  MALLOC_HOST_NAME(malloc_threadCleanup)
+
+#endif
@@ -0,0 +1,15 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * malloc.h for allocators built on host, host libc provides its own one
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include "../../include/malloc.h"
@@ -0,0 +1,23 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * stdlib.h for code built on host, adds libphoenix extensions to the host one
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_HOST_STDLIB_H_
+#define _LIBPHOENIX_HOST_STDLIB_H_
+
+#include_next <stdlib.h>
+
+
+extern size_t dtoa_shortest(double value, char *buf);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Debug output of allocators built on host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_HOST_SYS_DEBUG_H_
+#define _LIBPHOENIX_HOST_SYS_DEBUG_H_
+
+
+/* Writes s to stderr */
+extern void debug(const char *s);
+
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Thread primitives used by allocators built on host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_HOST_SYS_THREADS_H_
+#define _LIBPHOENIX_HOST_SYS_THREADS_H_
+
+#include <stdint.h>
+#include <unistd.h>
+
+
+/* Points to pthread_mutex_t allocated from host libc */
+typedef uintptr_t handle_t;
+
+
+extern int mutexCreate(handle_t *h);
+
+
+extern int mutexLock(handle_t h);
+
+
+extern int mutexTry(handle_t h);
+
+
+extern int mutexUnlock(handle_t h);
+
+
+extern int resourceDestroy(handle_t h);
+
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Thread primitives used by allocators built on host
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <sys/threads.h>
+#include <sys/debug.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+int mutexCreate(handle_t *h)
+{
+	pthread_mutex_t *mutex;
+	int err;
+
+	if ((mutex = malloc(sizeof(*mutex))) == NULL)
+		return -ENOMEM;
+
+	if ((err = pthread_mutex_init(mutex, NULL)) != 0) {
+		free(mutex);
+		return -err;
+	}
+
+	*h = (handle_t)mutex;
+
+	return 0;
+}
+
+
+int mutexLock(handle_t h)
+{
+	return -pthread_mutex_lock((pthread_mutex_t *)h);
+}
+
+
+int mutexTry(handle_t h)
+{
+	return -pthread_mutex_trylock((pthread_mutex_t *)h);
+}
+
+
+int mutexUnlock(handle_t h)
+{
+	return -pthread_mutex_unlock((pthread_mutex_t *)h);
+}
+
+
+int resourceDestroy(handle_t h)
+{
+	int err = pthread_mutex_destroy((pthread_mutex_t *)h);
+
+	if (err == 0)
+		free((void *)h);
+
+	return -err;
+}
+
+
+void debug(const char *s)
+{
+	write(STDERR_FILENO, s, strlen(s));
+}
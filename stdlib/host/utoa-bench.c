@@ -0,0 +1,183 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Decimal conversion microbenchmark run on host, compares the utoa engine with
+ * the repeated division it replaced in format_sprintf_num
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+/*
+ * Prints a tab separated table, ns per conversion for values of a given number of digits.
+ * Build with -m32 to see the cost of 64-bit division calls on 32-bit targets.
+ *
+ * Usage: utoa-bench [-n scale]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../utoa-internal.h"
+
+
+#define BENCH_VALUES 4096
+
+
+static const char digits[] = "0123456789";
+
+
+/* Conversion loops used by format_sprintf_num before the utoa engine */
+static char *bench_div32(uint32_t num32, char *tmp)
+{
+	if (num32 == 0)
+		*--tmp = '0';
+
+	while (num32 != 0) {
+		*--tmp = digits[num32 % 10];
+		num32 /= 10;
+	}
+
+	return tmp;
+}
+
+
+static char *bench_div64(uint64_t num64, char *tmp)
+{
+	if (num64 == 0)
+		*--tmp = '0';
+
+	while (num64 != 0) {
+		*--tmp = digits[num64 % 10];
+		num64 /= 10;
+	}
+
+	return tmp;
+}
+
+
+static char *bench_utoa32(uint64_t num, char *end)
+{
+	return __utoa_dec32((uint32_t)num, end);
+}
+
+
+static char *bench_utoa64(uint64_t num, char *end)
+{
+	return __utoa_dec64(num, end);
+}
+
+
+static char *bench_div32w(uint64_t num, char *end)
+{
+	return bench_div32((uint32_t)num, end);
+}
+
+
+static const struct {
+	const char *name;
+	unsigned int bits;
+	char *(*conv)(uint64_t num, char *end);
+} bench_convs[] = {
+	{ "division", 32, bench_div32w },
+	{ "utoa", 32, bench_utoa32 },
+	{ "division", 64, bench_div64 },
+	{ "utoa", 64, bench_utoa64 },
+};
+
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/* Values with exactly ndigits decimal digits, which fit in bits */
+static void bench_values(uint64_t *values, unsigned int ndigits, unsigned int bits, uint64_t *state)
+{
+	uint64_t lo = 0, hi = 9;
+	unsigned int i;
+
+	for (i = 1; i < ndigits; ++i) {
+		lo = (lo == 0) ? 10 : lo * 10;
+		hi = (hi > UINT64_MAX / 10) ? UINT64_MAX : hi * 10 + 9;
+	}
+
+	if ((bits == 32) && (hi > UINT32_MAX))
+		hi = UINT32_MAX;
+
+	for (i = 0; i < BENCH_VALUES; ++i) {
+		*state ^= *state >> 12;
+		*state ^= *state << 25;
+		*state ^= *state >> 27;
+		values[i] = lo + (*state * 0x2545f4914f6cdd1dULL) % (hi - lo + 1);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	static uint64_t values[BENCH_VALUES];
+	char buf[UTOA_DEC64_MAX + 1], ref[UTOA_DEC64_MAX + 1], *p;
+	unsigned int scale = 1, ndigits, k, i, r, rounds;
+	uint64_t state = 1;
+	volatile char sink = 0;
+	double start, elapsed;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		if (c != 'n') {
+			fprintf(stderr, "Usage: %s [-n scale]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		scale = strtoul(optarg, NULL, 10);
+	}
+
+	printf("# utoa\nconv\tbits\tdigits\tconversions\tns_per_conv\n");
+
+	for (ndigits = 1; ndigits <= 20; ++ndigits) {
+		rounds = 200 * scale;
+
+		for (k = 0; k < sizeof(bench_convs) / sizeof(bench_convs[0]); ++k) {
+			if ((bench_convs[k].bits == 32) && (ndigits > 10))
+				continue;
+
+			bench_values(values, ndigits, bench_convs[k].bits, &state);
+
+			/* Results have to match the old code */
+			for (i = 0; i < BENCH_VALUES; ++i) {
+				buf[UTOA_DEC64_MAX] = ref[UTOA_DEC64_MAX] = '\0';
+				p = bench_convs[k].conv(values[i], buf + UTOA_DEC64_MAX);
+				if (strcmp(p, bench_div64(values[i], ref + UTOA_DEC64_MAX)) != 0) {
+					fprintf(stderr, "utoa-bench: %s(%llu) gives %s\n", bench_convs[k].name, (unsigned long long)values[i], p);
+					return EXIT_FAILURE;
+				}
+			}
+
+			start = bench_now();
+			for (r = 0; r < rounds; ++r) {
+				for (i = 0; i < BENCH_VALUES; ++i)
+					sink += *bench_convs[k].conv(values[i], buf + UTOA_DEC64_MAX);
+			}
+			elapsed = bench_now() - start;
+
+			printf("%s\t%u\t%u\t%u\t%.2f\n", bench_convs[k].name, bench_convs[k].bits, ndigits, rounds * BENCH_VALUES,
+				elapsed * 1e9 / ((double)rounds * BENCH_VALUES));
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
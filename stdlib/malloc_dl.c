@@ -25,7 +25,10 @@
 #include <arch.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <limits.h>
+#include <stdatomic.h>
+#include <malloc.h>
 #include <string.h>
 #include <sysexits.h>
 #include <unistd.h>
@@ -35,16 +38,79 @@
 
 #define CHUNK_PUSED                1
 #define CHUNK_CUSED                2
+#define CHUNK_MMAPED               4
+
+/* Flag kept in the chunk->heap pointer (heaps are page aligned) of used chunks, followed by the profiler record index */
+#define CHUNK_SAMPLED              1
+#define CHUNK_TAGS                 ((uintptr_t) _PAGE_SIZE - 1)
 
 #define CHUNK_OVERHEAD             CEIL(__builtin_offsetof(chunk_t, next), 8)
 #define CHUNK_MIN_SIZE             CEIL(__builtin_offsetof(chunk_t, node) + sizeof(size_t), 8)
 #define CHUNK_SMALLBIN_MAX_SIZE    (256 - CHUNK_OVERHEAD)
 
+/* Per-thread cache of small chunks: chunks kept per bin and moved per refill/drain */
+#define TCACHE_BIN_MAX             16
+#define TCACHE_BATCH               8
 
-typedef struct {
+/* Chunks pushed to the remote list of an arena before the pushing thread tries to free them itself */
+#define REMOTE_RECLAIM             64
+
+/* Maximum number of arenas, can be lowered at runtime with MALLOC_ARENA_MAX environment variable */
+#ifndef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+#undef MALLOC_ARENAS
+#define MALLOC_ARENAS              1
+#elif !defined(MALLOC_ARENAS)
+#define MALLOC_ARENAS              4
+#endif
+
+/* Empty heaps kept mapped per arena for reuse, see mallopt(M_TRIM_THRESHOLD/M_TRIM_HEAPS). Default budget fits one heap of MALLOC_HEAP_MAX. */
+#ifndef MALLOC_TRIM_THRESHOLD
+#define MALLOC_TRIM_THRESHOLD      MALLOC_HEAP_MAX
+#endif
+
+#ifndef MALLOC_TRIM_HEAPS
+#define MALLOC_TRIM_HEAPS          4
+#endif
+
+/* New heaps are at least as big as the arena footprint (doubling it), up to this size */
+#ifndef MALLOC_HEAP_MAX
+#define MALLOC_HEAP_MAX            (1024 * 1024)
+#endif
+
+/* Number of records in the sampling profiler ring, see malloc_profile(). Record index has to fit in chunk tags. */
+#ifndef MALLOC_PROFILE_RECORDS
+#define MALLOC_PROFILE_RECORDS     512
+#endif
+
+_Static_assert(MALLOC_PROFILE_RECORDS <= _PAGE_SIZE / 2, "MALLOC_PROFILE_RECORDS is too big to be kept in chunk tags");
+
+/* Chunks of this size and above get a dedicated mapping, see mallopt(M_MMAP_THRESHOLD) */
+#ifndef MALLOC_MMAP_THRESHOLD
+#define MALLOC_MMAP_THRESHOLD      MALLOC_HEAP_MAX
+#endif
+
+/* Freeing a dedicated mapping raises the threshold up to this size, unless set with mallopt() */
+#ifndef MALLOC_MMAP_THRESHOLD_MAX
+#define MALLOC_MMAP_THRESHOLD_MAX  (4 * MALLOC_HEAP_MAX)
+#endif
+
+
+struct _malloc_arena_t;
+
+
+typedef struct _heap_t {
 	size_t size;
 	size_t freesz;
-	uint8_t space[];
+	struct _malloc_arena_t *arena;
+
+	/* Memory above top was never handed out and is still zero, except the last word of the heap */
+	uintptr_t top;
+
+	/* Used only when the heap is empty and retained or holds a single mmaped chunk */
+	struct _heap_t *next;
+	struct _heap_t *prev;
+
+	uint8_t space[] __attribute__((aligned(8)));
 } heap_t;
 
 
@@ -60,7 +126,7 @@ typedef struct _chunk_t {
 } chunk_t;
 
 
-struct {
+typedef struct _malloc_arena_t {
 	uint32_t sbinmap;
 	uint32_t lbinmap;
 	chunk_t *sbins[32];
@@ -69,13 +135,93 @@ struct {
 	size_t allocsz;
 	size_t freesz;
 
+	heap_t *retained;
+	unsigned int nretained;
+	size_t retainedsz;
+
+	heap_t *huge;
+	size_t nhuge;
+	size_t hugesz;
+
+	size_t nheaps;
+	size_t mappedsz;
+	size_t peaksz;
+	size_t nmmap;
+	size_t nmunmap;
+	size_t nreused;
+	size_t ncontended;
+	size_t nremote;
+
+	/* Start of the never used memory in the chunk returned by the last _malloc_allocFrom() */
+	uintptr_t fresh;
+
+	/* Chunks freed by threads using other arenas, linked through chunk->next, counted before pushing */
+	_Atomic(chunk_t *) remote;
+	_Atomic(size_t) nremotePending;
+
+	handle_t mutex;
+	int initialized;
+} malloc_arena_t;
+
+
+struct {
+	malloc_arena_t arenas[MALLOC_ARENAS];
+	unsigned int narenas;
+	unsigned int next;
+	int configured;
+	size_t nmigrated;
+
+	size_t trimThreshold;
+	unsigned int trimHeaps;
+
+	/* Read without locking, written under the mutex */
+	_Atomic(size_t) mmapThreshold;
+	int mmapFixed;
+
+	/* Sampling profiler, protected by the mutex */
+	size_t sampleRate;
+	size_t sampleLeft;
+	malloc_sample_t *samples;
+	size_t nsamples;
+
 	handle_t mutex;
 } malloc_common;
 
 
+static inline size_t malloc_mmapThreshold(void)
+{
+	return atomic_load_explicit(&malloc_common.mmapThreshold, memory_order_relaxed);
+}
+
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+
+/*
+ * Cached chunks stay marked as used, so they are never joined. Their header is not touched
+ * outside the lock (neighbours update CHUNK_PUSED), the prev field marks them as cached.
+ */
+typedef struct {
+	chunk_t *bins[32];
+	uint8_t count[32];
+	malloc_arena_t *arena;
+	size_t sampleLeft;
+} malloc_tcache_t;
+
+
+static __thread malloc_tcache_t malloc_tcache;
+
+#endif
+
+
+static inline heap_t *malloc_chunkHeap(chunk_t *chunk)
+{
+	return (heap_t *) ((uintptr_t) chunk->heap & ~CHUNK_TAGS);
+}
+
+
 static inline size_t malloc_chunkSize(chunk_t *chunk)
 {
-	return chunk->size & ~(CHUNK_CUSED | CHUNK_PUSED);
+	return chunk->size & ~(CHUNK_CUSED | CHUNK_PUSED | CHUNK_MMAPED);
 }
 
 
@@ -189,39 +335,41 @@ static void malloc_chunkInit(chunk_t *chunk, heap_t *heap, size_t size)
 
 static void _malloc_chunkAdd(chunk_t *chunk)
 {
+	malloc_arena_t *arena = chunk->heap->arena;
 	unsigned int idx;
 	size_t chunksz = malloc_chunkSize(chunk);
 	chunk_t *exist;
 
 	if (chunksz <= CHUNK_SMALLBIN_MAX_SIZE) {
 		idx = malloc_getsidx(chunksz);
-		LIST_ADD(&malloc_common.sbins[idx], chunk);
-		malloc_common.sbinmap |= (1 << idx);
+		LIST_ADD(&arena->sbins[idx], chunk);
+		arena->sbinmap |= (1 << idx);
 		return;
 	}
 
 	idx = malloc_getlidx(chunksz);
-	exist = lib_treeof(chunk_t, node, lib_rbInsert(&malloc_common.lbins[idx], &chunk->node));
+	exist = lib_treeof(chunk_t, node, lib_rbInsert(&arena->lbins[idx], &chunk->node));
 	if (exist != NULL)
 		/* Mark chunk as not actually being in the tree */
 		chunk->node.parent = &chunk->node;
 	LIST_ADD(&exist, chunk);
 
-	malloc_common.lbinmap |= (1 << idx);
+	arena->lbinmap |= (1 << idx);
 }
 
 
 static void _malloc_chunkRemove(chunk_t *chunk)
 {
+	malloc_arena_t *arena = chunk->heap->arena;
 	unsigned int idx;
 	size_t chunksz = malloc_chunkSize(chunk);
 	chunk_t *next = chunk;
 
 	if (chunksz <= CHUNK_SMALLBIN_MAX_SIZE) {
 		idx = malloc_getsidx(chunksz);
-		LIST_REMOVE(&malloc_common.sbins[idx], chunk);
-		if (malloc_common.sbins[idx] == NULL)
-			malloc_common.sbinmap &= ~(1 << idx);
+		LIST_REMOVE(&arena->sbins[idx], chunk);
+		if (arena->sbins[idx] == NULL)
+			arena->sbinmap &= ~(1 << idx);
 
 		return;
 	}
@@ -230,14 +378,14 @@ static void _malloc_chunkRemove(chunk_t *chunk)
 	LIST_REMOVE(&next, chunk);
 
 	if (next == NULL) {
-		lib_rbRemove(&malloc_common.lbins[idx], &chunk->node);
+		lib_rbRemove(&arena->lbins[idx], &chunk->node);
 
-		if (malloc_common.lbins[idx].root == NULL)
-			malloc_common.lbinmap &= ~(1 << idx);
+		if (arena->lbins[idx].root == NULL)
+			arena->lbinmap &= ~(1 << idx);
 	}
 	else if (chunk->node.parent != &chunk->node) {
 		next->node = chunk->node;
-		rb_transplant(&malloc_common.lbins[idx], &chunk->node, &next->node);
+		rb_transplant(&arena->lbins[idx], &chunk->node, &next->node);
 		if (next->node.left != NULL)
 			next->node.left->parent = &next->node;
 		if (next->node.right != NULL)
@@ -296,31 +444,96 @@ static void _malloc_chunkJoin(chunk_t *chunk)
 }
 
 
-static void malloc_heapInit(heap_t *heap, size_t size)
+static void malloc_heapInit(heap_t *heap, malloc_arena_t *arena, size_t size)
 {
 	heap->size = size;
 	heap->freesz = heap->size - sizeof(heap_t);
+	heap->arena = arena;
+	heap->top = (uintptr_t) heap->space + sizeof(chunk_t);
+	arena->freesz += heap->freesz;
+	heap->next = NULL;
+	heap->prev = NULL;
+}
+
+
+static inline int malloc_heapIsEmpty(heap_t *heap)
+{
+	return (heap->freesz == heap->size - sizeof(heap_t));
+}
+
+
+static void _malloc_heapRelease(heap_t *heap)
+{
+	malloc_arena_t *arena = heap->arena;
+
+	_malloc_chunkRemove((chunk_t *) heap->space);
+	arena->freesz -= heap->freesz;
+	arena->nheaps--;
+	arena->mappedsz -= heap->size;
+	munmap(heap, heap->size);
+	arena->nmunmap++;
+}
+
+
+static void _malloc_heapRetain(heap_t *heap)
+{
+	malloc_arena_t *arena = heap->arena;
+
+	/* Heaps grow with the mmap threshold, so the budget bounds each of them, the first one too */
+	if ((arena->nretained >= malloc_common.trimHeaps) || (arena->retainedsz + heap->size > malloc_common.trimThreshold)) {
+		_malloc_heapRelease(heap);
+		return;
+	}
+
+	LIST_ADD(&arena->retained, heap);
+	arena->nretained++;
+	arena->retainedsz += heap->size;
 }
 
 
-static heap_t *_malloc_heapAlloc(size_t size)
+static void _malloc_heapReuse(heap_t *heap)
+{
+	malloc_arena_t *arena = heap->arena;
+
+	LIST_REMOVE(&arena->retained, heap);
+	arena->nretained--;
+	arena->retainedsz -= heap->size;
+	arena->nreused++;
+}
+
+
+static heap_t *_malloc_heapAlloc(malloc_arena_t *arena, size_t size)
 {
 	chunk_t *chunk;
 	size_t heapSize = CEIL(sizeof(heap_t) + size, _PAGE_SIZE);
-	heap_t *heap;
+	size_t growSize = CEIL(min(arena->mappedsz, (size_t)MALLOC_HEAP_MAX), _PAGE_SIZE);
+	heap_t *heap = MAP_FAILED;
 
 	if (heapSize < size) {
 		return NULL;
 	}
 
-	heap = mmap(NULL, heapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	/* Grow geometrically to limit the number of heaps, requests above the cap get an exact fit */
+	if (heapSize < growSize) {
+		heap = mmap(NULL, growSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (heap != MAP_FAILED) {
+			heapSize = growSize;
+		}
+	}
+
 	if (heap == MAP_FAILED) {
-		return NULL;
+		heap = mmap(NULL, heapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (heap == MAP_FAILED) {
+			return NULL;
+		}
 	}
+	arena->nheaps++;
+	arena->mappedsz += heapSize;
+	arena->nmmap++;
 
 	chunk = (chunk_t*) heap->space;
 
-	malloc_heapInit(heap, heapSize);
+	malloc_heapInit(heap, arena, heapSize);
 	malloc_chunkInit(chunk, heap, FLOOR(heap->size - sizeof(heap_t), 8));
 	chunk->size |= CHUNK_PUSED;
 	_malloc_chunkAdd(chunk);
@@ -330,7 +543,15 @@ static heap_t *_malloc_heapAlloc(size_t size)
 
 static inline void *_malloc_allocFrom(chunk_t *chunk, size_t size)
 {
+	heap_t *heap = chunk->heap;
+	malloc_arena_t *arena = heap->arena;
 	chunk_t *chunkNext;
+	uintptr_t top;
+
+	if (heap->next != NULL)
+		_malloc_heapReuse(heap);
+
+	arena->fresh = max(heap->top, (uintptr_t) chunk + CHUNK_OVERHEAD);
 
 	if (malloc_chunkCanSplit(chunk, size))
 		_malloc_chunkSplit(chunk, size);
@@ -338,17 +559,25 @@ static inline void *_malloc_allocFrom(chunk_t *chunk, size_t size)
 		_malloc_chunkRemove(chunk);
 
 	chunk->heap->freesz -= malloc_chunkSize(chunk);
+	arena->freesz -= malloc_chunkSize(chunk);
+	arena->allocsz += malloc_chunkSize(chunk);
+	if (arena->allocsz + arena->hugesz > arena->peaksz)
+		arena->peaksz = arena->allocsz + arena->hugesz;
 
 	chunk->size |= CHUNK_CUSED;
 
 	if ((chunkNext = malloc_chunkNext(chunk)) != NULL)
 		chunkNext->size |= CHUNK_PUSED;
 
+	/* Cover the header and links of the following chunk, free chunks never write beyond them */
+	top = min((uintptr_t) chunk + malloc_chunkSize(chunk) + sizeof(chunk_t), (uintptr_t) heap + heap->size);
+	heap->top = max(heap->top, top);
+
 	return (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD);
 }
 
 
-static void *_malloc_allocLarge(size_t size)
+static void *_malloc_allocLarge(malloc_arena_t *arena, size_t size)
 {
 	/* Lookup table to speed-up operation reverse to malloc_getlidx(). */
 	static const size_t lookup[32] = {
@@ -359,14 +588,14 @@ static void *_malloc_allocLarge(size_t size)
 	};
 
 	unsigned int idx = malloc_getlidx(size);
-	unsigned int binmap = malloc_common.lbinmap & ~((1 << idx) - 1);
+	unsigned int binmap = arena->lbinmap & ~((1 << idx) - 1);
 	heap_t *heap;
 	chunk_t *chunk = NULL;
 	chunk_t t;
 	t.size = size;
 
 	while (idx < 32 && binmap) {
-		chunk = lib_treeof(chunk_t, node, lib_rbFindEx(malloc_common.lbins[idx].root, &t.node, malloc_find));
+		chunk = lib_treeof(chunk_t, node, lib_rbFindEx(arena->lbins[idx].root, &t.node, malloc_find));
 		if (chunk != NULL)
 			break;
 
@@ -375,7 +604,7 @@ static void *_malloc_allocLarge(size_t size)
 
 	if (chunk == NULL) {
 		idx = malloc_getlidx(size);
-		if ((heap = _malloc_heapAlloc(max(lookup[idx], size))) == NULL)
+		if ((heap = _malloc_heapAlloc(arena, max(lookup[idx], size))) == NULL)
 			return NULL;
 
 		chunk = (chunk_t *) heap->space;
@@ -385,10 +614,10 @@ static void *_malloc_allocLarge(size_t size)
 }
 
 
-static void *_malloc_allocSmall(size_t size)
+static void *_malloc_allocSmall(malloc_arena_t *arena, size_t size)
 {
 	unsigned int idx = malloc_getsidx(size);
-	unsigned int binmap = malloc_common.sbinmap & ~((1 << idx) - 1);
+	unsigned int binmap = arena->sbinmap & ~((1 << idx) - 1);
 	size_t targetSize = idx << 3;
 	size_t idxSize;
 	chunk_t *chunk;
@@ -396,12 +625,12 @@ static void *_malloc_allocSmall(size_t size)
 
 	if (binmap)
 		idx = __builtin_ctz(binmap);
-	else if (malloc_common.lbinmap)
-		return _malloc_allocLarge(size);
+	else if (arena->lbinmap)
+		return _malloc_allocLarge(arena, size);
 
 	idxSize = idx << 3;
-	if ((chunk = malloc_common.sbins[idx]) == NULL) {
-		if ((heap = _malloc_heapAlloc(idxSize)) == NULL)
+	if ((chunk = arena->sbins[idx]) == NULL) {
+		if ((heap = _malloc_heapAlloc(arena, idxSize)) == NULL)
 			return NULL;
 
 		chunk = (chunk_t *) heap->space;
@@ -417,278 +646,1570 @@ static void *_malloc_allocSmall(size_t size)
 }
 
 
-size_t malloc_usable_size(void *ptr)
+static void malloc_arenaInit(malloc_arena_t *arena)
 {
-	chunk_t *chunk;
-	size_t size = 0;
+	int i;
 
-	if (ptr != NULL) {
-		mutexLock(malloc_common.mutex);
-		chunk = (chunk_t *)((uintptr_t)ptr - CHUNK_OVERHEAD);
-		size = malloc_chunkSize(chunk) - CHUNK_OVERHEAD;
-		mutexUnlock(malloc_common.mutex);
+	arena->allocsz = 0;
+	arena->freesz = 0;
+	arena->sbinmap = 0;
+	arena->lbinmap = 0;
+
+	arena->retained = NULL;
+	arena->nretained = 0;
+	arena->retainedsz = 0;
+
+	arena->huge = NULL;
+	arena->nhuge = 0;
+	arena->hugesz = 0;
+
+	arena->nheaps = 0;
+	arena->mappedsz = 0;
+	arena->peaksz = 0;
+	arena->nmmap = 0;
+	arena->nmunmap = 0;
+	arena->nreused = 0;
+	arena->ncontended = 0;
+	arena->nremote = 0;
+	arena->fresh = 0;
+	atomic_init(&arena->remote, NULL);
+	atomic_init(&arena->nremotePending, 0);
+
+	for (i = 0; i < 32; ++i) {
+		arena->sbins[i] = NULL;
+		lib_rbInit(&arena->lbins[i], malloc_cmp, NULL);
 	}
 
-	return size;
+	mutexCreate(&arena->mutex);
+	arena->initialized = 1;
 }
 
 
-void *malloc(size_t size)
+static void _malloc_chunkFree(chunk_t *chunk)
 {
-	void *ptr = NULL;
-
-	if (size == 0) {
-		return NULL;
-	}
-
-	if ((size + CHUNK_OVERHEAD) < size) {
-		errno = ENOMEM;
-		return NULL;
-	}
+	chunk_t *chunkNext;
+	heap_t *heap = chunk->heap;
 
-	size = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+	chunk->size &= ~CHUNK_CUSED;
+	malloc_chunkSetFooter(chunk);
 
-	mutexLock(malloc_common.mutex);
-	if (size <= CHUNK_SMALLBIN_MAX_SIZE) {
-		ptr = _malloc_allocSmall(size);
-	}
-	else {
-		ptr = _malloc_allocLarge(size);
-	}
-	mutexUnlock(malloc_common.mutex);
+	if ((chunkNext = malloc_chunkNext(chunk)) != NULL)
+		chunkNext->size &= ~CHUNK_PUSED;
 
-	if (ptr == NULL) {
-		errno = ENOMEM;
-	}
+	heap->freesz += malloc_chunkSize(chunk);
+	heap->arena->freesz += malloc_chunkSize(chunk);
+	heap->arena->allocsz -= malloc_chunkSize(chunk);
+	_malloc_chunkAdd(chunk);
+	_malloc_chunkJoin(chunk);
 
-	return ptr;
+	if (malloc_heapIsEmpty(heap))
+		_malloc_heapRetain(heap);
 }
 
 
-void *calloc(size_t nitems, size_t size)
+static void _malloc_remoteReclaim(malloc_arena_t *arena)
 {
-	if ((nitems != 0) && (size > SIZE_MAX / nitems)) {
-		errno = ENOMEM;
-		return NULL;
-	}
+	chunk_t *chunk, *next;
+	size_t n = 0;
 
-	size_t allocSize = nitems * size;
+	if (atomic_load_explicit(&arena->remote, memory_order_relaxed) == NULL)
+		return;
 
-	void *ptr = malloc(allocSize);
-	if (ptr == NULL) {
-		return NULL;
+	chunk = atomic_exchange_explicit(&arena->remote, NULL, memory_order_acquire);
+	for (; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		chunk->prev = NULL;
+		_malloc_chunkFree(chunk);
+		n++;
 	}
 
-	memset(ptr, 0, allocSize);
-	return ptr;
+	arena->nremote += n;
+	atomic_fetch_sub_explicit(&arena->nremotePending, n, memory_order_relaxed);
 }
 
 
-void free(void *ptr)
+static inline void malloc_lock(malloc_arena_t *arena)
 {
-	chunk_t *chunk, *chunkNext;
-	heap_t *heap;
+	if (mutexTry(arena->mutex) < 0) {
+		mutexLock(arena->mutex);
+		arena->ncontended++;
+	}
+}
 
-	if (ptr == NULL)
-		return;
 
-	mutexLock(malloc_common.mutex);
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
 
-	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
-	heap = chunk->heap;
+static malloc_arena_t *malloc_arenaAssign(void)
+{
+	malloc_arena_t *arena;
+	unsigned long n;
+	char *env;
 
-	if (!(chunk->size & CHUNK_CUSED)) {
-		debug("Double free detected\n");
-		_exit(EX_SOFTWARE);
-	}
+	mutexLock(malloc_common.mutex);
 
-	chunk->size &= ~CHUNK_CUSED;
-	malloc_chunkSetFooter(chunk);
+	/* Environment is not available yet in _malloc_init(), the main thread starts on arena 0 */
+	if (malloc_common.configured == 0) {
+		if ((env = getenv("MALLOC_ARENA_MAX")) != NULL) {
+			n = strtoul(env, NULL, 10);
+			if ((n > 0) && (n < malloc_common.narenas))
+				malloc_common.narenas = n;
+		}
 
-	if ((chunkNext = malloc_chunkNext(chunk)) != NULL)
-		chunkNext->size &= ~CHUNK_PUSED;
+		malloc_common.configured = 1;
+	}
 
-	heap->freesz += malloc_chunkSize(chunk);
-	_malloc_chunkAdd(chunk);
-	_malloc_chunkJoin(chunk);
+	if (malloc_tcache.arena != NULL)
+		malloc_common.nmigrated++;
 
-	if (heap->freesz == heap->size - sizeof(heap_t)) {
-		chunk = (chunk_t *) heap->space;
-		_malloc_chunkRemove(chunk);
-		munmap(heap, heap->size);
-	}
+	arena = &malloc_common.arenas[malloc_common.next++ % malloc_common.narenas];
+	if (arena->initialized == 0)
+		malloc_arenaInit(arena);
 
 	mutexUnlock(malloc_common.mutex);
+
+	return arena;
 }
 
 
-void *realloc(void *ptr, size_t size)
+static malloc_arena_t *malloc_arenaLock(void)
 {
-	chunk_t *chunk, *sibling, *next;
-	heap_t *heap;
-	size_t chunksz;
-
-	void *p;
-
-	if (ptr == NULL)
-		return malloc(size);
+	malloc_arena_t *arena = malloc_tcache.arena;
 
-	if (size == 0) {
-		free(ptr);
-		return NULL;
+	if (arena == NULL) {
+		arena = malloc_arenaAssign();
+		malloc_tcache.arena = arena;
 	}
 
-	if ((size + CHUNK_OVERHEAD) < size) {
-		errno = ENOMEM;
-		return NULL;
+	if (mutexTry(arena->mutex) < 0) {
+		/* Arena is contended, move the thread to the next one */
+		if (malloc_common.narenas > 1) {
+			arena = malloc_arenaAssign();
+			malloc_tcache.arena = arena;
+		}
+
+		malloc_lock(arena);
 	}
 
-	size = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+	_malloc_remoteReclaim(arena);
 
-	mutexLock(malloc_common.mutex);
+	return arena;
+}
 
-	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
-	heap = chunk->heap;
-	chunksz = malloc_chunkSize(chunk);
+#else
 
+static inline malloc_arena_t *malloc_arenaLock(void)
+{
+	malloc_lock(&malloc_common.arenas[0]);
+	_malloc_remoteReclaim(&malloc_common.arenas[0]);
+	return &malloc_common.arenas[0];
+}
 
-	if (size < chunksz && malloc_chunkCanSplit(chunk, size)) {
-		sibling = (chunk_t *) ((uintptr_t) chunk + size);
-		malloc_chunkInit(sibling, heap, chunksz - size);
-		sibling->size |= CHUNK_PUSED;
-		_malloc_chunkAdd(sibling);
-		heap->freesz += chunksz - size;
+#endif
 
-		chunk->size = size | CHUNK_CUSED | (chunk->size & CHUNK_PUSED);
 
-		_malloc_chunkJoin(sibling);
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
 
-		if ((next = malloc_chunkNext(sibling)) != NULL)
-			next->size &= ~CHUNK_PUSED;
-	}
-	else if (size > chunksz) {
-		if ((next = malloc_chunkNext(chunk)) != NULL && !(next->size & CHUNK_CUSED) &&
-				(malloc_chunkSize(next) >= (size - chunksz))) {
-			_malloc_allocFrom(next, size - chunksz);
-			chunk->size += malloc_chunkSize(next);
-		}
-		else {
-			mutexUnlock(malloc_common.mutex);
+/*
+ * Hands the chunk over to its arena without taking the lock, the owner frees it on the next allocation.
+ * Arena may have no owner any more (its threads migrated or exited), so every REMOTE_RECLAIM pushes
+ * the pusher frees the list itself if the arena is not locked. Only trying the lock is safe here,
+ * the caller may hold its own arena.
+ */
+static void malloc_remotePush(malloc_arena_t *arena, chunk_t *chunk)
+{
+	chunk_t *head = atomic_load_explicit(&arena->remote, memory_order_relaxed);
+	size_t pending = atomic_fetch_add_explicit(&arena->nremotePending, 1, memory_order_relaxed) + 1;
 
-			p = malloc(size);
-			if (p != NULL) {
-				memcpy(p, ptr, chunksz - CHUNK_OVERHEAD);
-				free(ptr);
-			}
+	chunk->prev = (chunk_t *) &arena->remote;
+	do {
+		chunk->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(&arena->remote, &head, chunk, memory_order_release, memory_order_relaxed));
 
-			return p;
-		}
+	if (((pending % REMOTE_RECLAIM) == 0) && (mutexTry(arena->mutex) == 0)) {
+		_malloc_remoteReclaim(arena);
+		mutexUnlock(arena->mutex);
 	}
-
-	mutexUnlock(malloc_common.mutex);
-
-	return ptr;
 }
 
 
-void _malloc_init(void)
+/* Tells if the arena is not the caller's, a thread which didn't allocate yet gets its arena here */
+static inline int malloc_arenaForeign(malloc_arena_t *arena)
 {
-	int i;
-
-	malloc_common.allocsz = 0;
-	malloc_common.freesz = 0;
-	malloc_common.sbinmap = 0;
-	malloc_common.lbinmap = 0;
-
-	for (i = 0; i < 32; ++i) {
-		malloc_common.sbins[i] = NULL;
-		lib_rbInit(&malloc_common.lbins[i], malloc_cmp, NULL);
-	}
+	if (malloc_tcache.arena == NULL)
+		malloc_tcache.arena = malloc_arenaAssign();
 
-	mutexCreate(&malloc_common.mutex);
+	return (arena != malloc_tcache.arena);
 }
 
 
-#define ASSERT(cond, ...) do {					\
-		if (!(cond)) {					\
-			printf(__VA_ARGS__);			\
-			for (;;) ;				\
-		}						\
-	} while (0)
+static inline void malloc_tcachePush(unsigned int idx, chunk_t *chunk)
+{
+	chunk->prev = (chunk_t *) &malloc_tcache;
+	chunk->next = malloc_tcache.bins[idx];
+	malloc_tcache.bins[idx] = chunk;
+	malloc_tcache.count[idx]++;
+}
 
 
-static void malloc_test_heap(chunk_t *chunk)
+static inline chunk_t *malloc_tcachePop(unsigned int idx)
 {
-	chunk_t *next = malloc_chunkNext(chunk);
-	const char *unmerged = "malloc_dl: unmerged free chunks\n";
-	const char *pused = "malloc_dl: invalid PUSED flag\n";
+	chunk_t *chunk = malloc_tcache.bins[idx];
 
-	ASSERT(chunk->size & CHUNK_PUSED, pused);
-	ASSERT(next == NULL || (next->size & CHUNK_CUSED), unmerged);
-	ASSERT(next == NULL || !(next->size & CHUNK_PUSED), pused);
+	if (chunk != NULL) {
+		malloc_tcache.bins[idx] = chunk->next;
+		malloc_tcache.count[idx]--;
+		chunk->prev = NULL;
+	}
 
-	next = malloc_chunkPrev(chunk);
-	ASSERT(next == NULL || (next->size & CHUNK_CUSED), unmerged);
-	ASSERT(chunk->size & CHUNK_PUSED, pused);
+	return chunk;
 }
 
 
-static void malloc_test_lbin(int lidx, chunk_t *chunk)
+static void malloc_tcacheDrain(unsigned int idx, unsigned int keep)
 {
-	size_t sz;
-	chunk_t *c;
+	malloc_arena_t *arena = NULL;
+	chunk_t *chunk;
 
-	if (chunk == NULL)
-		return;
+	/* Chunks of other arenas are handed over to their owners, only the own arena is locked */
+	while (malloc_tcache.count[idx] > keep) {
+		chunk = malloc_tcachePop(idx);
 
-	malloc_test_heap(chunk);
+		if (malloc_arenaForeign(chunk->heap->arena)) {
+			malloc_remotePush(chunk->heap->arena, chunk);
+			continue;
+		}
 
-	sz = malloc_chunkSize(chunk);
-	ASSERT(!(chunk->size & CHUNK_CUSED), "malloc_dl: free chunk marked as used\n");
-	ASSERT(malloc_getlidx(sz) == lidx, "malloc_dl: wrong chunk size (%zu) at lbin %d", sz, lidx);
+		if (arena == NULL) {
+			arena = malloc_tcache.arena;
+			malloc_lock(arena);
+			_malloc_remoteReclaim(arena);
+		}
 
-	c = chunk;
-	do  {
-		ASSERT(!(c->size & CHUNK_CUSED), "malloc_dl: free chunk marked as used\n");
-		ASSERT(malloc_chunkSize(c) == sz, "malloc_dl: wrong chunk size at lidx %d\n", lidx);
-	} while (c->next != chunk && (c = c->next));
+		_malloc_chunkFree(chunk);
+	}
 
-	malloc_test_lbin(lidx, lib_treeof(chunk_t, node, chunk->node.left));
-	malloc_test_lbin(lidx, lib_treeof(chunk_t, node, chunk->node.right));
+	if (arena != NULL)
+		mutexUnlock(arena->mutex);
 }
 
 
-void malloc_test(void)
+static void *malloc_tcacheAlloc(size_t size)
 {
+	unsigned int idx = malloc_getsidx(size), cidx, i;
+	chunk_t *chunk = malloc_tcachePop(idx);
+	malloc_arena_t *arena;
+	void *ptr;
+
+	if (chunk != NULL)
+		return (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD);
+
+	/* Refill the bin in one batch, so the following allocations don't take the lock */
+	arena = malloc_arenaLock();
+	ptr = _malloc_allocSmall(arena, size);
+	for (i = 1; (ptr != NULL) && (i < TCACHE_BATCH); ++i) {
+		if ((chunk = _malloc_allocSmall(arena, size)) == NULL)
+			break;
+
+		chunk = (chunk_t *) ((uintptr_t) chunk - CHUNK_OVERHEAD);
+		cidx = malloc_getsidx(malloc_chunkSize(chunk));
+		if ((malloc_chunkSize(chunk) > CHUNK_SMALLBIN_MAX_SIZE) || (malloc_tcache.count[cidx] >= TCACHE_BIN_MAX)) {
+			_malloc_chunkFree(chunk);
+			break;
+		}
+
+		malloc_tcachePush(cidx, chunk);
+	}
+	mutexUnlock(arena->mutex);
+
+	return ptr;
+}
+
+
+static void malloc_tcacheCheck(chunk_t *chunk, unsigned int idx)
+{
+	chunk_t *it;
+
+	if (chunk->prev != (chunk_t *) &malloc_tcache)
+		return;
+
+	for (it = malloc_tcache.bins[idx]; it != NULL; it = it->next) {
+		if (it == chunk) {
+			debug("Double free detected\n");
+			_exit(EX_SOFTWARE);
+		}
+	}
+}
+
+
+static void malloc_tcacheFree(chunk_t *chunk, unsigned int idx)
+{
+	malloc_tcacheCheck(chunk, idx);
+
+	if (malloc_tcache.count[idx] >= TCACHE_BIN_MAX)
+		malloc_tcacheDrain(idx, TCACHE_BIN_MAX / 2);
+
+	malloc_tcachePush(idx, chunk);
+}
+
+#endif
+
+
+/* Huge chunks live alone in their own mapping, never enter the bins and are not split or joined */
+static void *malloc_allocHuge(size_t size)
+{
+	size_t mapsz = CEIL(sizeof(heap_t) + size, _PAGE_SIZE);
+	malloc_arena_t *arena;
+	chunk_t *chunk;
+	heap_t *heap;
+
+	if (mapsz < size)
+		return NULL;
+
+	heap = mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (heap == MAP_FAILED)
+		return NULL;
+
+	arena = malloc_arenaLock();
+
+	heap->size = mapsz;
+	heap->freesz = 0;
+	heap->arena = arena;
+
+	chunk = (chunk_t *) heap->space;
+	chunk->size = FLOOR(mapsz - sizeof(heap_t), 8) | CHUNK_CUSED | CHUNK_PUSED | CHUNK_MMAPED;
+	chunk->heap = heap;
+
+	LIST_ADD(&arena->huge, heap);
+	arena->nhuge++;
+	arena->hugesz += mapsz;
+	arena->nmmap++;
+	if (arena->allocsz + arena->hugesz > arena->peaksz)
+		arena->peaksz = arena->allocsz + arena->hugesz;
+
+	mutexUnlock(arena->mutex);
+
+	return (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD);
+}
+
+
+static void malloc_freeHuge(chunk_t *chunk)
+{
+	heap_t *heap = chunk->heap;
+	malloc_arena_t *arena = heap->arena;
+
+	malloc_lock(arena);
+	LIST_REMOVE(&arena->huge, heap);
+	arena->nhuge--;
+	arena->hugesz -= heap->size;
+	arena->nmunmap++;
+	mutexUnlock(arena->mutex);
+
+	/* Repeated allocations of this size are served from a heap, which can be retained */
+	if ((heap->size > malloc_mmapThreshold()) && (heap->size <= MALLOC_MMAP_THRESHOLD_MAX)) {
+		mutexLock(malloc_common.mutex);
+		if ((malloc_common.mmapFixed == 0) && (heap->size > malloc_mmapThreshold()))
+			atomic_store_explicit(&malloc_common.mmapThreshold, heap->size, memory_order_relaxed);
+		mutexUnlock(malloc_common.mutex);
+	}
+
+	munmap(heap, heap->size);
+}
+
+
+static int malloc_resizeHuge(chunk_t *chunk, size_t size)
+{
+	heap_t *heap = chunk->heap;
+	malloc_arena_t *arena = heap->arena;
+	size_t mapsz = CEIL(sizeof(heap_t) + size, _PAGE_SIZE);
+	void *end = (void *) ((uintptr_t) heap + heap->size);
+	void *ext;
+
+	if (mapsz < size)
+		return -1;
+
+	/* Chunk size follows the request even if the mapping is kept whole, see free_sized() */
+	if (mapsz == heap->size) {
+		chunk->size = FLOOR(mapsz - sizeof(heap_t), 8) | CHUNK_CUSED | CHUNK_PUSED | CHUNK_MMAPED;
+		return 0;
+	}
+
+	if (mapsz < heap->size) {
+		/* Give back the tail pages, keep the whole mapping if that's not possible */
+		if (munmap((void *) ((uintptr_t) heap + mapsz), heap->size - mapsz) < 0) {
+			chunk->size = FLOOR(mapsz - sizeof(heap_t), 8) | CHUNK_CUSED | CHUNK_PUSED | CHUNK_MMAPED;
+			return 0;
+		}
+	}
+	else {
+		/* Try to map the pages directly following the mapping */
+		ext = mmap(end, mapsz - heap->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ext == MAP_FAILED)
+			return -1;
+
+		if (ext != end) {
+			munmap(ext, mapsz - heap->size);
+			return -1;
+		}
+	}
+
+	malloc_lock(arena);
+	arena->hugesz += mapsz - heap->size;
+	if (mapsz > heap->size)
+		arena->nmmap++;
+	if (arena->allocsz + arena->hugesz > arena->peaksz)
+		arena->peaksz = arena->allocsz + arena->hugesz;
+	mutexUnlock(arena->mutex);
+
+	heap->size = mapsz;
+	chunk->size = FLOOR(mapsz - sizeof(heap_t), 8) | CHUNK_CUSED | CHUNK_PUSED | CHUNK_MMAPED;
+
+	return 0;
+}
+
+
+static void *malloc_reallocHuge(chunk_t *chunk, size_t size)
+{
+	void *ptr;
+
+	if (malloc_resizeHuge(chunk, size) == 0)
+		return (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD);
+
+	if ((ptr = malloc_allocHuge(size)) == NULL)
+		return NULL;
+
+	memcpy(ptr, (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD), malloc_chunkSize(chunk) - CHUNK_OVERHEAD);
+	malloc_freeHuge(chunk);
+
+	return ptr;
+}
+
+
+static void malloc_profileAlloc(void *ptr, size_t size, void *caller)
+{
+	chunk_t *chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+	malloc_sample_t *sample;
+	size_t *left;
+	uintptr_t idx;
+	int tid;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	left = &malloc_tcache.sampleLeft;
+#else
+	left = &malloc_common.sampleLeft;
+#endif
+
+	/* Take one allocation per sampleRate bytes */
+	if (*left > size) {
+		*left -= size;
+		return;
+	}
+	*left = malloc_common.sampleRate;
+
+	tid = gettid();
+
+	mutexLock(malloc_common.mutex);
+	if (malloc_common.samples != NULL) {
+		idx = malloc_common.nsamples++ % MALLOC_PROFILE_RECORDS;
+		sample = &malloc_common.samples[idx];
+		sample->ptr = ptr;
+		sample->size = size;
+		sample->caller = caller;
+		sample->tid = tid;
+		sample->live = 1;
+
+		chunk->heap = (heap_t *) ((uintptr_t) chunk->heap | (idx << 1) | CHUNK_SAMPLED);
+	}
+	mutexUnlock(malloc_common.mutex);
+}
+
+
+/* Closes the sample of ptr, unless its record was already reused */
+static void malloc_profileClose(void *ptr, uintptr_t tags)
+{
+	malloc_sample_t *sample;
+
+	mutexLock(malloc_common.mutex);
+	if (malloc_common.samples != NULL) {
+		sample = &malloc_common.samples[tags >> 1];
+		if (sample->ptr == ptr)
+			sample->live = 0;
+	}
+	mutexUnlock(malloc_common.mutex);
+}
+
+
+static void malloc_profileFree(chunk_t *chunk)
+{
+	uintptr_t tags = (uintptr_t) chunk->heap & CHUNK_TAGS;
+
+	chunk->heap = malloc_chunkHeap(chunk);
+	malloc_profileClose((void *) ((uintptr_t) chunk + CHUNK_OVERHEAD), tags);
+}
+
+
+/* Copies records with sequence numbers seq...seq + n - 1 still present in the ring */
+static size_t malloc_profileCopy(malloc_sample_t *buf, size_t seq, size_t n)
+{
+	size_t i = 0;
+
+	mutexLock(malloc_common.mutex);
+	if (malloc_common.samples != NULL) {
+		if (malloc_common.nsamples > MALLOC_PROFILE_RECORDS)
+			seq = max(seq, malloc_common.nsamples - MALLOC_PROFILE_RECORDS);
+
+		for (; (i < n) && (seq < malloc_common.nsamples); ++i, ++seq)
+			buf[i] = malloc_common.samples[seq % MALLOC_PROFILE_RECORDS];
+	}
+	mutexUnlock(malloc_common.mutex);
+
+	return i;
+}
+
+
+size_t malloc_usable_size(void *ptr)
+{
+	malloc_arena_t *arena;
+	chunk_t *chunk;
+	size_t size = 0;
+
+	if (ptr != NULL) {
+		chunk = (chunk_t *)((uintptr_t)ptr - CHUNK_OVERHEAD);
+		arena = malloc_chunkHeap(chunk)->arena;
+		malloc_lock(arena);
+		size = malloc_chunkSize(chunk) - CHUNK_OVERHEAD;
+		mutexUnlock(arena->mutex);
+	}
+
+	return size;
+}
+
+
+static inline void *malloc_alloc(size_t size)
+{
+	malloc_arena_t *arena;
+	void *ptr = NULL;
+
+	if (size == 0) {
+		return NULL;
+	}
+
+	if ((size + CHUNK_OVERHEAD) < size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+
+	if (size >= malloc_mmapThreshold()) {
+		ptr = malloc_allocHuge(size);
+		if (ptr == NULL) {
+			errno = ENOMEM;
+		}
+
+		return ptr;
+	}
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	if (size <= CHUNK_SMALLBIN_MAX_SIZE) {
+		ptr = malloc_tcacheAlloc(size);
+		if (ptr == NULL) {
+			errno = ENOMEM;
+		}
+
+		return ptr;
+	}
+#endif
+
+	arena = malloc_arenaLock();
+	if (size <= CHUNK_SMALLBIN_MAX_SIZE) {
+		ptr = _malloc_allocSmall(arena, size);
+	}
+	else {
+		ptr = _malloc_allocLarge(arena, size);
+	}
+	mutexUnlock(arena->mutex);
+
+	if (ptr == NULL) {
+		errno = ENOMEM;
+	}
+
+	return ptr;
+}
+
+
+void *malloc(size_t size)
+{
+	void *ptr = malloc_alloc(size);
+
+	if ((ptr != NULL) && (malloc_common.sampleRate != 0))
+		malloc_profileAlloc(ptr, size, __builtin_return_address(0));
+
+	return ptr;
+}
+
+
+/* Returns in dirty size of the leading part of the block that has to be cleared, the rest is known to be zero */
+static void *malloc_allocZeroed(size_t size, size_t *dirty)
+{
+	size_t chunksz = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+	malloc_arena_t *arena;
+	chunk_t *chunk;
+	heap_t *heap;
+	void *ptr;
+
+	*dirty = size;
+
+	/* Clearing small chunks is cheaper than tracking them, these come from the thread cache */
+	if (((size + CHUNK_OVERHEAD) < size) || (chunksz <= CHUNK_SMALLBIN_MAX_SIZE) || (chunksz >= malloc_mmapThreshold())) {
+		ptr = malloc_alloc(size);
+
+		/* Dedicated mappings are always fresh */
+		if ((ptr != NULL) && (((chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD))->size & CHUNK_MMAPED))
+			*dirty = 0;
+
+		return ptr;
+	}
+
+	arena = malloc_arenaLock();
+	ptr = _malloc_allocLarge(arena, chunksz);
+	if (ptr != NULL) {
+		chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+		heap = chunk->heap;
+		*dirty = min(size, arena->fresh - (uintptr_t) ptr);
+
+		/* Footer of the last free chunk may be left in the last word of the heap */
+		if ((uintptr_t) chunk + malloc_chunkSize(chunk) == (uintptr_t) heap + heap->size)
+			*((size_t *) ((uintptr_t) heap + heap->size) - 1) = 0;
+	}
+	mutexUnlock(arena->mutex);
+
+	if (ptr == NULL) {
+		errno = ENOMEM;
+	}
+
+	return ptr;
+}
+
+
+void *calloc(size_t nitems, size_t size)
+{
+	size_t dirty;
+
+	if ((nitems != 0) && (size > SIZE_MAX / nitems)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size_t allocSize = nitems * size;
+
+	void *ptr = malloc_allocZeroed(allocSize, &dirty);
+	if (ptr == NULL) {
+		return NULL;
+	}
+
+	if (malloc_common.sampleRate != 0)
+		malloc_profileAlloc(ptr, allocSize, __builtin_return_address(0));
+
+	memset(ptr, 0, dirty);
+	return ptr;
+}
+
+
+void _malloc_threadCleanup(void)
+{
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	unsigned int idx;
+
+	for (idx = 0; idx < 32; ++idx)
+		malloc_tcacheDrain(idx, 0);
+
+	malloc_tcache.arena = NULL;
+#endif
+}
+
+
+/* Checks chunk passed to free and releases dedicated mappings, returns the arena the chunk has to be freed to */
+static malloc_arena_t *malloc_freePrepare(chunk_t *chunk)
+{
+	malloc_arena_t *arena;
+
+	if (!(chunk->size & CHUNK_CUSED)) {
+		debug("Double free detected\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	if ((uintptr_t) chunk->heap & CHUNK_SAMPLED)
+		malloc_profileFree(chunk);
+
+	if (chunk->size & CHUNK_MMAPED) {
+		malloc_freeHuge(chunk);
+		return NULL;
+	}
+
+	arena = chunk->heap->arena;
+
+	/* Remote chunks stay marked as used until their owner frees them */
+	if (chunk->prev == (chunk_t *) &arena->remote) {
+		debug("Double free detected\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	return arena;
+}
+
+
+/* Frees the chunk of known size, callers of free_sized() spare reading it from the header */
+static inline void malloc_free(chunk_t *chunk, size_t chunksz)
+{
+	malloc_arena_t *arena;
+
+	if ((arena = malloc_freePrepare(chunk)) == NULL)
+		return;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	if (chunksz <= CHUNK_SMALLBIN_MAX_SIZE) {
+		malloc_tcacheFree(chunk, malloc_getsidx(chunksz));
+		return;
+	}
+
+	if (malloc_arenaForeign(arena)) {
+		malloc_remotePush(arena, chunk);
+		return;
+	}
+#endif
+
+	malloc_lock(arena);
+	_malloc_chunkFree(chunk);
+	mutexUnlock(arena->mutex);
+}
+
+
+/*
+ * Returns size of the chunk if the size given to free_sized() could have been used to allocate it, 0 otherwise.
+ * Chunks are split if the rest makes a free chunk (realloc() growing in place takes at least a chunk header from the
+ * neighbour) and dedicated mappings are rounded up to pages, so the chunk can't be bigger than that. Size bits of used
+ * chunk are not changed by other threads, the header is read without the lock.
+ */
+static size_t malloc_sizedCheck(chunk_t *chunk, size_t size)
+{
+	size_t chunksz = malloc_chunkSize(chunk);
+	size_t slack = (chunk->size & CHUNK_MMAPED) ? _PAGE_SIZE : (CHUNK_MIN_SIZE + CHUNK_OVERHEAD);
+
+	if ((size + CHUNK_OVERHEAD) < size)
+		return 0;
+
+	size = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+	if ((size > chunksz) || (chunksz - size >= slack))
+		return 0;
+
+	return chunksz;
+}
+
+
+void free(void *ptr)
+{
+	chunk_t *chunk;
+
+	if (ptr == NULL)
+		return;
+
+	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+	malloc_free(chunk, malloc_chunkSize(chunk));
+}
+
+
+void free_sized(void *ptr, size_t size)
+{
+	chunk_t *chunk;
+	size_t chunksz;
+
+	if (ptr == NULL)
+		return;
+
+	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+	if ((chunksz = malloc_sizedCheck(chunk, size)) == 0) {
+		debug("free_sized: size does not match the allocation\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	malloc_free(chunk, chunksz);
+}
+
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size)
+{
+	chunk_t *chunk;
+	size_t chunksz;
+
+	if (ptr == NULL)
+		return;
+
+	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0) || (((uintptr_t) ptr & (alignment - 1)) != 0) ||
+			((chunksz = malloc_sizedCheck(chunk, size)) == 0)) {
+		debug("free_aligned_sized: alignment or size does not match the allocation\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	malloc_free(chunk, chunksz);
+}
+
+
+void free_batch(void **ptrs, size_t n)
+{
+	malloc_arena_t *arena, *locked = NULL;
+	chunk_t *chunk;
+	size_t i;
+
+	/* Chunks go straight to the bins, the lock is kept while consecutive chunks share the arena */
+	for (i = 0; i < n; ++i) {
+		if (ptrs[i] == NULL)
+			continue;
+
+		chunk = (chunk_t *) ((uintptr_t) ptrs[i] - CHUNK_OVERHEAD);
+
+		/* Dedicated mappings take the arena lock on their own */
+		if ((chunk->size & CHUNK_MMAPED) && (locked != NULL)) {
+			mutexUnlock(locked->mutex);
+			locked = NULL;
+		}
+
+		if ((arena = malloc_freePrepare(chunk)) == NULL)
+			continue;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+		if (malloc_chunkSize(chunk) <= CHUNK_SMALLBIN_MAX_SIZE)
+			malloc_tcacheCheck(chunk, malloc_getsidx(malloc_chunkSize(chunk)));
+
+		if (malloc_arenaForeign(arena)) {
+			malloc_remotePush(arena, chunk);
+			continue;
+		}
+#endif
+
+		if (arena != locked) {
+			if (locked != NULL)
+				mutexUnlock(locked->mutex);
+
+			locked = arena;
+			malloc_lock(locked);
+		}
+
+		_malloc_chunkFree(chunk);
+	}
+
+	if (locked != NULL)
+		mutexUnlock(locked->mutex);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+	chunk_t *chunk, *sibling, *next;
+	malloc_arena_t *arena;
+	heap_t *heap;
+	size_t chunksz;
+
+	uintptr_t tags;
+	void *p;
+
+	if (ptr == NULL)
+		return malloc(size);
+
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
+	if ((size + CHUNK_OVERHEAD) < size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+
+	chunk = (chunk_t *) ((uintptr_t) ptr - CHUNK_OVERHEAD);
+
+	/* The resized block is not tracked, the sample is closed as if it was freed once resizing succeeds */
+	tags = (uintptr_t) chunk->heap & CHUNK_TAGS;
+	chunk->heap = malloc_chunkHeap(chunk);
+
+	if (chunk->size & CHUNK_MMAPED) {
+		p = malloc_reallocHuge(chunk, size);
+		if (p == NULL) {
+			chunk->heap = (heap_t *) ((uintptr_t) chunk->heap | tags);
+			errno = ENOMEM;
+		}
+		else if (tags != 0) {
+			malloc_profileClose(ptr, tags);
+		}
+
+		return p;
+	}
+
+	heap = chunk->heap;
+	arena = heap->arena;
+
+	malloc_lock(arena);
+
+	chunksz = malloc_chunkSize(chunk);
+
+
+	if (size < chunksz && malloc_chunkCanSplit(chunk, size)) {
+		sibling = (chunk_t *) ((uintptr_t) chunk + size);
+		malloc_chunkInit(sibling, heap, chunksz - size);
+		sibling->size |= CHUNK_PUSED;
+		_malloc_chunkAdd(sibling);
+		heap->freesz += chunksz - size;
+		arena->freesz += chunksz - size;
+		arena->allocsz -= chunksz - size;
+
+		chunk->size = size | CHUNK_CUSED | (chunk->size & CHUNK_PUSED);
+
+		_malloc_chunkJoin(sibling);
+
+		if ((next = malloc_chunkNext(sibling)) != NULL)
+			next->size &= ~CHUNK_PUSED;
+	}
+	else if (size > chunksz) {
+		if ((next = malloc_chunkNext(chunk)) != NULL && !(next->size & CHUNK_CUSED) &&
+				(malloc_chunkSize(next) >= (size - chunksz))) {
+			/* Taking less than a chunk header can't split and would swallow the whole neighbour */
+			_malloc_allocFrom(next, max(size - chunksz, CHUNK_OVERHEAD));
+			chunk->size += malloc_chunkSize(next);
+		}
+		else {
+			mutexUnlock(arena->mutex);
+
+			p = malloc_alloc(size);
+			if (p == NULL) {
+				chunk->heap = (heap_t *) ((uintptr_t) chunk->heap | tags);
+				return NULL;
+			}
+
+			memcpy(p, ptr, chunksz - CHUNK_OVERHEAD);
+			if (tags != 0)
+				malloc_profileClose(ptr, tags);
+			free(ptr);
+
+			if (malloc_common.sampleRate != 0)
+				malloc_profileAlloc(p, size, __builtin_return_address(0));
+
+			return p;
+		}
+	}
+
+	mutexUnlock(arena->mutex);
+
+	if (tags != 0)
+		malloc_profileClose(ptr, tags);
+
+	return ptr;
+}
+
+
+static void *_malloc_allocAligned(malloc_arena_t *arena, size_t alignment, size_t size)
+{
+	chunk_t *chunk, *aligned, *rest;
+	size_t chunksz, lead;
+	uintptr_t ptr;
+
+	/* Worst case needs room for a leading free chunk and the alignment slack */
+	if ((size + alignment + CHUNK_MIN_SIZE) < size)
+		return NULL;
+
+	if (size + alignment + CHUNK_MIN_SIZE <= CHUNK_SMALLBIN_MAX_SIZE)
+		ptr = (uintptr_t) _malloc_allocSmall(arena, size + alignment + CHUNK_MIN_SIZE);
+	else
+		ptr = (uintptr_t) _malloc_allocLarge(arena, size + alignment + CHUNK_MIN_SIZE);
+
+	if (ptr == 0)
+		return NULL;
+
+	chunk = (chunk_t *) (ptr - CHUNK_OVERHEAD);
+	chunksz = malloc_chunkSize(chunk);
+
+	if ((ptr & (alignment - 1)) != 0) {
+		/* Leading slack has to be big enough to form a free chunk */
+		lead = CEIL(ptr, alignment) - ptr;
+		while (lead < CHUNK_MIN_SIZE)
+			lead += alignment;
+
+		aligned = (chunk_t *) ((uintptr_t) chunk + lead);
+		aligned->heap = chunk->heap;
+		aligned->size = (chunksz - lead) | CHUNK_CUSED | CHUNK_PUSED;
+
+		chunk->size = lead | CHUNK_CUSED | (chunk->size & CHUNK_PUSED);
+		_malloc_chunkFree(chunk);
+
+		chunk = aligned;
+		chunksz -= lead;
+	}
+
+	if (malloc_chunkCanSplit(chunk, size)) {
+		rest = (chunk_t *) ((uintptr_t) chunk + size);
+		rest->heap = chunk->heap;
+		rest->size = (chunksz - size) | CHUNK_CUSED | CHUNK_PUSED;
+
+		chunk->size = size | CHUNK_CUSED | (chunk->size & CHUNK_PUSED);
+		_malloc_chunkFree(rest);
+	}
+
+	return (void *) ((uintptr_t) chunk + CHUNK_OVERHEAD);
+}
+
+
+static void *malloc_aligned(size_t alignment, size_t size, void *caller)
+{
+	malloc_arena_t *arena;
+	size_t chunksz;
+	void *ptr;
+
+	if (alignment <= 8) {
+		ptr = malloc_alloc(size);
+	}
+	else {
+		if (size == 0)
+			return NULL;
+
+		if ((size + CHUNK_OVERHEAD) < size) {
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		chunksz = CEIL(max(size + CHUNK_OVERHEAD, CHUNK_MIN_SIZE), 8);
+
+		arena = malloc_arenaLock();
+		ptr = _malloc_allocAligned(arena, alignment, chunksz);
+		mutexUnlock(arena->mutex);
+
+		if (ptr == NULL) {
+			errno = ENOMEM;
+		}
+	}
+
+	if ((ptr != NULL) && (malloc_common.sampleRate != 0))
+		malloc_profileAlloc(ptr, size, caller);
+
+	return ptr;
+}
+
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+	int err = errno;
+
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0) || ((alignment % sizeof(void *)) != 0)) {
+		return EINVAL;
+	}
+
+	ptr = malloc_aligned(alignment, size, __builtin_return_address(0));
+	if ((ptr == NULL) && (size != 0)) {
+		errno = err;
+		return ENOMEM;
+	}
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return malloc_aligned(alignment, size, __builtin_return_address(0));
+}
+
+
+void *memalign(size_t alignment, size_t size)
+{
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return malloc_aligned(alignment, size, __builtin_return_address(0));
+}
+
+
+int malloc_trim(size_t pad)
+{
+	malloc_arena_t *arena;
+	int i, released = 0;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	/* Cached chunks of the caller may keep otherwise empty heaps alive */
+	for (i = 0; i < 32; ++i)
+		malloc_tcacheDrain(i, 0);
+#endif
+
+	for (i = 0; i < MALLOC_ARENAS; ++i) {
+		arena = &malloc_common.arenas[i];
+		if (arena->initialized == 0)
+			continue;
+
+		malloc_lock(arena);
+		_malloc_remoteReclaim(arena);
+		while ((arena->retained != NULL) && (arena->retainedsz > pad)) {
+			heap_t *heap = arena->retained;
+
+			LIST_REMOVE(&arena->retained, heap);
+			arena->nretained--;
+			arena->retainedsz -= heap->size;
+			_malloc_heapRelease(heap);
+			released = 1;
+		}
+		mutexUnlock(arena->mutex);
+	}
+
+	return released;
+}
+
+
+int mallopt(int param, int value)
+{
+	if (value < 0)
+		return 0;
+
+	switch (param) {
+		case M_TRIM_THRESHOLD:
+			malloc_common.trimThreshold = value;
+			break;
+
+		case M_TRIM_HEAPS:
+			malloc_common.trimHeaps = value;
+			break;
+
+		case M_MMAP_THRESHOLD:
+			if ((size_t)value <= CHUNK_SMALLBIN_MAX_SIZE)
+				return 0;
+
+			mutexLock(malloc_common.mutex);
+			atomic_store_explicit(&malloc_common.mmapThreshold, value, memory_order_relaxed);
+			malloc_common.mmapFixed = 1;
+			mutexUnlock(malloc_common.mutex);
+			break;
+
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+
+typedef struct {
+	size_t count;
+	size_t size;
+} malloc_binstat_t;
+
+
+typedef struct {
+	malloc_binstat_t sbins[32];
+	malloc_binstat_t lbins[32];
+	size_t largest;
+
+	size_t mappedsz;
+	size_t allocsz;
+	size_t freesz;
+	size_t peaksz;
+	size_t nheaps;
+	size_t nretained;
+	size_t retainedsz;
+	size_t nhuge;
+	size_t hugesz;
+	size_t nmmap;
+	size_t nmunmap;
+	size_t nreused;
+	size_t ncontended;
+	size_t nremote;
+} malloc_arenastat_t;
+
+
+static void _malloc_arenaStats(malloc_arena_t *arena, malloc_arenastat_t *st)
+{
+	rbnode_t *node;
+	chunk_t *chunk, *it;
 	int i;
-	chunk_t *chunk;
+
+	memset(st, 0, sizeof(*st));
+
+	for (i = 0; i < 32; ++i) {
+		if ((chunk = arena->sbins[i]) == NULL)
+			continue;
+
+		it = chunk;
+		do {
+			st->sbins[i].count++;
+			st->sbins[i].size += malloc_chunkSize(it);
+			st->largest = max(st->largest, malloc_chunkSize(it));
+		} while ((it = it->next) != chunk);
+	}
+
+	for (i = 0; i < 32; ++i) {
+		for (node = lib_rbMinimum(arena->lbins[i].root); node != NULL; node = lib_rbNext(node)) {
+			chunk = lib_treeof(chunk_t, node, node);
+			it = chunk;
+			do {
+				st->lbins[i].count++;
+				st->lbins[i].size += malloc_chunkSize(it);
+				st->largest = max(st->largest, malloc_chunkSize(it));
+			} while ((it = it->next) != chunk);
+		}
+	}
+
+	st->mappedsz = arena->mappedsz;
+	st->allocsz = arena->allocsz;
+	st->freesz = arena->freesz;
+	st->peaksz = arena->peaksz;
+	st->nheaps = arena->nheaps;
+	st->nretained = arena->nretained;
+	st->retainedsz = arena->retainedsz;
+	st->nhuge = arena->nhuge;
+	st->hugesz = arena->hugesz;
+	st->nmmap = arena->nmmap;
+	st->nmunmap = arena->nmunmap;
+	st->nreused = arena->nreused;
+	st->ncontended = arena->ncontended;
+	st->nremote = arena->nremote;
+}
+
+
+/* Copies the statistics out, so they can be printed without holding the arena lock */
+static int malloc_arenaStats(int idx, malloc_arenastat_t *st)
+{
+	malloc_arena_t *arena = &malloc_common.arenas[idx];
+
+	if (arena->initialized == 0)
+		return -1;
+
+	mutexLock(arena->mutex);
+	_malloc_remoteReclaim(arena);
+	_malloc_arenaStats(arena, st);
+	mutexUnlock(arena->mutex);
+
+	return 0;
+}
+
+
+static unsigned int malloc_fragmentation(malloc_arenastat_t *st)
+{
+	/* Share of free memory that can't be handed out as a single block */
+	if (st->freesz == 0)
+		return 0;
+
+	return (unsigned int) (100 - (st->largest * 100) / st->freesz);
+}
+
+
+struct mallinfo2 mallinfo2(void)
+{
+	struct mallinfo2 info;
+	malloc_arenastat_t st;
+	int i, j;
+
+	memset(&info, 0, sizeof(info));
+
+	for (i = 0; i < MALLOC_ARENAS; ++i) {
+		if (malloc_arenaStats(i, &st) < 0)
+			continue;
+
+		for (j = 0; j < 32; ++j) {
+			info.ordblks += st.sbins[j].count + st.lbins[j].count;
+			info.smblks += st.sbins[j].count;
+			info.fsmblks += st.sbins[j].size;
+		}
+
+		info.arena += st.mappedsz;
+		info.hblks += st.nhuge;
+		info.hblkhd += st.hugesz;
+		info.usmblks += st.peaksz;
+		info.uordblks += st.allocsz + st.hugesz;
+		info.fordblks += st.freesz;
+		info.keepcost += st.retainedsz;
+	}
+
+	return info;
+}
+
+
+void malloc_stats(void)
+{
+	malloc_arenastat_t st;
+	size_t mapped = 0, inuse = 0, huge = 0, nhuge = 0;
+	int i;
+
+	for (i = 0; i < MALLOC_ARENAS; ++i) {
+		if (malloc_arenaStats(i, &st) < 0)
+			continue;
+
+		fprintf(stderr, "Arena %d:\n", i);
+		fprintf(stderr, "system bytes     = %10zu\n", st.mappedsz);
+		fprintf(stderr, "in use bytes     = %10zu\n", st.allocsz);
+		fprintf(stderr, "free bytes       = %10zu\n", st.freesz);
+		fprintf(stderr, "peak bytes       = %10zu\n", st.peaksz);
+		fprintf(stderr, "heaps            = %10zu\n", st.nheaps);
+		fprintf(stderr, "retained heaps   = %10zu (%zu bytes)\n", st.nretained, st.retainedsz);
+		fprintf(stderr, "fragmentation    = %9u%%\n", malloc_fragmentation(&st));
+		fprintf(stderr, "mmap calls       = %10zu\n", st.nmmap);
+		fprintf(stderr, "munmap calls     = %10zu\n", st.nmunmap);
+		fprintf(stderr, "mmap avoided     = %10zu\n", st.nreused);
+		fprintf(stderr, "lock contention  = %10zu\n", st.ncontended);
+		fprintf(stderr, "remote frees     = %10zu\n", st.nremote);
+
+		mapped += st.mappedsz + st.hugesz;
+		inuse += st.allocsz + st.hugesz;
+		huge += st.hugesz;
+		nhuge += st.nhuge;
+	}
+
+	fprintf(stderr, "Total (incl. mmap):\n");
+	fprintf(stderr, "system bytes     = %10zu\n", mapped);
+	fprintf(stderr, "in use bytes     = %10zu\n", inuse);
+	fprintf(stderr, "mmap regions     = %10zu\n", nhuge);
+	fprintf(stderr, "mmap bytes       = %10zu\n", huge);
+	fprintf(stderr, "arena migrations = %10zu\n", malloc_common.nmigrated);
+}
+
+
+int malloc_info(int options, FILE *stream)
+{
+	malloc_arenastat_t st;
+	size_t from, to;
+	int i, j;
+
+	if (options != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fprintf(stream, "<malloc version=\"1\">\n");
+
+	for (i = 0; i < MALLOC_ARENAS; ++i) {
+		if (malloc_arenaStats(i, &st) < 0)
+			continue;
+
+		fprintf(stream, "<heap nr=\"%d\">\n<sizes>\n", i);
+		for (j = 0; j < 32; ++j) {
+			if (st.sbins[j].count != 0)
+				fprintf(stream, "<size from=\"%d\" to=\"%d\" total=\"%zu\" count=\"%zu\"/>\n",
+					j << 3, j << 3, st.sbins[j].size, st.sbins[j].count);
+		}
+		for (j = 0; j < 32; ++j) {
+			if (st.lbins[j].count == 0)
+				continue;
+
+			from = (j == 0) ? CHUNK_SMALLBIN_MAX_SIZE + 8 : (size_t)(2 | (j & 1)) << ((j >> 1) + 7);
+			to = (j == 31) ? SIZE_MAX : ((size_t)(2 | ((j + 1) & 1)) << (((j + 1) >> 1) + 7)) - 1;
+			fprintf(stream, "<size from=\"%zu\" to=\"%zu\" total=\"%zu\" count=\"%zu\"/>\n",
+				from, to, st.lbins[j].size, st.lbins[j].count);
+		}
+		fprintf(stream, "</sizes>\n");
+
+		fprintf(stream, "<total type=\"heap\" count=\"%zu\" size=\"%zu\"/>\n", st.nheaps, st.mappedsz);
+		fprintf(stream, "<total type=\"retained\" count=\"%zu\" size=\"%zu\"/>\n", st.nretained, st.retainedsz);
+		fprintf(stream, "<total type=\"mmap\" count=\"%zu\" size=\"%zu\"/>\n", st.nhuge, st.hugesz);
+		fprintf(stream, "<system type=\"current\" size=\"%zu\"/>\n", st.mappedsz + st.hugesz);
+		fprintf(stream, "<system type=\"max\" size=\"%zu\"/>\n", st.peaksz);
+		fprintf(stream, "<aspace type=\"inuse\" size=\"%zu\"/>\n", st.allocsz + st.hugesz);
+		fprintf(stream, "<aspace type=\"free\" size=\"%zu\"/>\n", st.freesz);
+		fprintf(stream, "<fragmentation percent=\"%u\" largest=\"%zu\"/>\n", malloc_fragmentation(&st), st.largest);
+		fprintf(stream, "<calls mmap=\"%zu\" munmap=\"%zu\" avoided=\"%zu\"/>\n", st.nmmap, st.nmunmap, st.nreused);
+		fprintf(stream, "<lock contended=\"%zu\"/>\n", st.ncontended);
+		fprintf(stream, "<remote count=\"%zu\"/>\n", st.nremote);
+		fprintf(stream, "</heap>\n");
+	}
+
+	fprintf(stream, "<migrations count=\"%zu\"/>\n", malloc_common.nmigrated);
+	fprintf(stream, "</malloc>\n");
+
+	return 0;
+}
+
+
+int malloc_profile(size_t rate)
+{
+	void *samples;
+
+	mutexLock(malloc_common.mutex);
+	if ((rate != 0) && (malloc_common.samples == NULL)) {
+		samples = mmap(NULL, CEIL(MALLOC_PROFILE_RECORDS * sizeof(malloc_sample_t), _PAGE_SIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (samples == MAP_FAILED) {
+			mutexUnlock(malloc_common.mutex);
+			errno = ENOMEM;
+			return -1;
+		}
+
+		malloc_common.samples = samples;
+		malloc_common.nsamples = 0;
+	}
+	malloc_common.sampleRate = rate;
+	mutexUnlock(malloc_common.mutex);
+
+	return 0;
+}
+
+
+size_t malloc_profileRead(malloc_sample_t *buf, size_t n)
+{
+	size_t seq;
+
+	mutexLock(malloc_common.mutex);
+	seq = malloc_common.nsamples - min(n, malloc_common.nsamples);
+	mutexUnlock(malloc_common.mutex);
+
+	return malloc_profileCopy(buf, seq, n);
+}
+
+
+int malloc_profileDump(FILE *stream)
+{
+	malloc_sample_t buf[16];
+	size_t seq, i, n;
+
 	mutexLock(malloc_common.mutex);
+	seq = malloc_common.nsamples - min(malloc_common.nsamples, (size_t)MALLOC_PROFILE_RECORDS);
+	mutexUnlock(malloc_common.mutex);
+
+	fprintf(stream, "# rate %zu\n# ptr size caller tid live\n", malloc_common.sampleRate);
+
+	/* Records are printed outside the lock, these overwritten meanwhile are skipped */
+	while ((n = malloc_profileCopy(buf, seq, sizeof(buf) / sizeof(buf[0]))) != 0) {
+		for (i = 0; i < n; ++i)
+			fprintf(stream, "%p %zu %p %d %d\n", buf[i].ptr, buf[i].size, buf[i].caller, buf[i].tid, buf[i].live);
+		seq += n;
+	}
+
+	return 0;
+}
+
+
+void _malloc_init(void)
+{
+	int i;
+
+	for (i = 0; i < MALLOC_ARENAS; ++i)
+		malloc_common.arenas[i].initialized = 0;
+
+	malloc_common.narenas = MALLOC_ARENAS;
+	malloc_common.next = 1;
+	malloc_common.configured = 0;
+	malloc_common.nmigrated = 0;
+	malloc_common.trimThreshold = MALLOC_TRIM_THRESHOLD;
+	malloc_common.trimHeaps = MALLOC_TRIM_HEAPS;
+	atomic_init(&malloc_common.mmapThreshold, MALLOC_MMAP_THRESHOLD);
+	malloc_common.mmapFixed = 0;
+	malloc_common.sampleRate = 0;
+	malloc_common.sampleLeft = 0;
+	malloc_common.samples = NULL;
+	malloc_common.nsamples = 0;
+
+	mutexCreate(&malloc_common.mutex);
+	malloc_arenaInit(&malloc_common.arenas[0]);
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	malloc_tcache.arena = &malloc_common.arenas[0];
+#endif
+}
+
+
+#define ASSERT(cond, ...) do {					\
+		if (!(cond)) {					\
+			printf(__VA_ARGS__);			\
+			for (;;) ;				\
+		}						\
+	} while (0)
+
+
+static void malloc_test_heap(chunk_t *chunk)
+{
+	chunk_t *next = malloc_chunkNext(chunk);
+	const char *unmerged = "malloc_dl: unmerged free chunks\n";
+	const char *pused = "malloc_dl: invalid PUSED flag\n";
+
+	ASSERT(chunk->size & CHUNK_PUSED, pused);
+	ASSERT(next == NULL || (next->size & CHUNK_CUSED), unmerged);
+	ASSERT(next == NULL || !(next->size & CHUNK_PUSED), pused);
+
+	next = malloc_chunkPrev(chunk);
+	ASSERT(next == NULL || (next->size & CHUNK_CUSED), unmerged);
+	ASSERT(chunk->size & CHUNK_PUSED, pused);
+}
+
+
+static void malloc_test_lbin(size_t lidx, chunk_t *chunk)
+{
+	size_t sz;
+	chunk_t *c;
+
+	if (chunk == NULL)
+		return;
+
+	malloc_test_heap(chunk);
+
+	sz = malloc_chunkSize(chunk);
+	ASSERT(!(chunk->size & CHUNK_CUSED), "malloc_dl: free chunk marked as used\n");
+	ASSERT(malloc_getlidx(sz) == lidx, "malloc_dl: wrong chunk size (%zu) at lbin %zu", sz, lidx);
+
+	c = chunk;
+	do  {
+		ASSERT(!(c->size & CHUNK_CUSED), "malloc_dl: free chunk marked as used\n");
+		ASSERT(malloc_chunkSize(c) == sz, "malloc_dl: wrong chunk size at lidx %zu\n", lidx);
+	} while (c->next != chunk && (c = c->next));
+
+	malloc_test_lbin(lidx, lib_treeof(chunk_t, node, chunk->node.left));
+	malloc_test_lbin(lidx, lib_treeof(chunk_t, node, chunk->node.right));
+}
+
+
+static void malloc_test_arena(malloc_arena_t *arena)
+{
+	size_t i;
+	chunk_t *chunk;
+	mutexLock(arena->mutex);
 
 	for (i = 0; i < 32; ++i) {
-		if (malloc_common.sbinmap & (1 << i)) {
-			ASSERT(malloc_common.sbins[i] != NULL, "malloc_dl: sbinmap bit %d set but bin is empty\n", i);
-			chunk = malloc_common.sbins[i];
+		if (arena->sbinmap & (1 << i)) {
+			ASSERT(arena->sbins[i] != NULL, "malloc_dl: sbinmap bit %zu set but bin is empty\n", i);
+			chunk = arena->sbins[i];
 
 			do  {
 				malloc_test_heap(chunk);
 				ASSERT(!(chunk->size & CHUNK_CUSED), "malloc_dl: free chunk marked as used\n");
-				ASSERT(malloc_chunkSize(chunk) == (i << 3), "malloc_dl: wrong chunk size at sidx %d\n", i);
-			} while (chunk->next != malloc_common.sbins[i] && (chunk = chunk->next));
+				ASSERT(malloc_chunkSize(chunk) == (i << 3), "malloc_dl: wrong chunk size at sidx %zu\n", i);
+			} while (chunk->next != arena->sbins[i] && (chunk = chunk->next));
 		}
 		else
-			ASSERT(malloc_common.sbins[i] == NULL, "malloc_dl: empty lbin %d should be NULL\n", i);
+			ASSERT(arena->sbins[i] == NULL, "malloc_dl: empty lbin %zu should be NULL\n", i);
 	}
 
 	for (i = 0; i < 32; ++i) {
-		if (malloc_common.lbinmap & (1 << i)) {
-			ASSERT(malloc_common.lbins[i].root != NULL, "malloc_dl: lbinmap bit %d set but bin is empty\n", i);
-			chunk = lib_treeof(chunk_t, node, malloc_common.lbins[i].root);
+		if (arena->lbinmap & (1 << i)) {
+			ASSERT(arena->lbins[i].root != NULL, "malloc_dl: lbinmap bit %zu set but bin is empty\n", i);
+			chunk = lib_treeof(chunk_t, node, arena->lbins[i].root);
 
 			malloc_test_lbin(i, chunk);
 		}
 		else
-			ASSERT(malloc_common.lbins[i].root == NULL, "malloc_dl: empty lbin %d should be NULL\n", i);
+			ASSERT(arena->lbins[i].root == NULL, "malloc_dl: empty lbin %zu should be NULL\n", i);
 	}
 
-	mutexUnlock(malloc_common.mutex);
+	mutexUnlock(arena->mutex);
+}
+
+
+void malloc_test(void)
+{
+	int i;
+
+	for (i = 0; i < MALLOC_ARENAS; ++i) {
+		if (malloc_common.arenas[i].initialized != 0)
+			malloc_test_arena(&malloc_common.arenas[i]);
+	}
 }
@@ -0,0 +1,945 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * stdlib/malloc (TLSF)
+ *
+ * Two-level segregated fit allocator, malloc and free run in bounded time
+ * as long as the request is served from the already mapped pool
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <errno.h>
+#include <sys/list.h>
+#include <sys/minmax.h>
+#include <sys/threads.h>
+#include <sys/mman.h>
+#include <sys/debug.h>
+
+#include <arch.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <malloc.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#define CEIL(value, size)          ((((value) + (size) - 1) / (size)) * (size))
+
+#define BLOCK_FREE                 1
+#define BLOCK_MMAPED               2
+
+#define BLOCK_OVERHEAD             CEIL(__builtin_offsetof(block_t, nextFree), 8)
+#define BLOCK_MIN_SIZE             CEIL(sizeof(block_t), 8)
+#define HEAP_OVERHEAD              CEIL(sizeof(heap_t), 8)
+
+/* Each power of two size range is split into TLSF_SLI lists */
+#define TLSF_SLI_LOG2              4
+#define TLSF_SLI                   (1 << TLSF_SLI_LOG2)
+
+/* Blocks smaller than TLSF_SMALL are kept in the first level list 0, in 8 byte steps */
+#define TLSF_SMALL_LOG2            (TLSF_SLI_LOG2 + 3)
+#define TLSF_SMALL                 (1 << TLSF_SMALL_LOG2)
+
+/* Blocks kept in the lists are smaller than 2^TLSF_FLI_MAX */
+#define TLSF_FLI_MAX               30
+#define TLSF_FLI                   (TLSF_FLI_MAX - TLSF_SMALL_LOG2 + 1)
+
+/* Minimal size of a heap mapped when the pool runs out of memory */
+#ifndef MALLOC_HEAP_SIZE
+#define MALLOC_HEAP_SIZE           (64 * 1024)
+#endif
+
+/* Memory mapped in _malloc_init(), so that the process never maps memory while allocating */
+#ifndef MALLOC_POOL_SIZE
+#define MALLOC_POOL_SIZE           0
+#endif
+
+/* Blocks of this size and above get a dedicated mapping, see mallopt(M_MMAP_THRESHOLD) */
+#ifndef MALLOC_MMAP_THRESHOLD
+#define MALLOC_MMAP_THRESHOLD      (1024 * 1024)
+#endif
+
+
+typedef struct _heap_t {
+	struct _heap_t *next;
+	struct _heap_t *prev;
+	size_t size;
+} heap_t;
+
+
+typedef struct _block_t {
+	struct _block_t *prevPhys; /* Previous block in the heap, NULL for the first one */
+	size_t size;
+
+	/* Following fields are used only when the block is free */
+	struct _block_t *nextFree;
+	struct _block_t *prevFree;
+} block_t;
+
+
+struct {
+	uint32_t flmap;
+	uint32_t slmap[TLSF_FLI];
+	block_t *blocks[TLSF_FLI][TLSF_SLI];
+
+	heap_t *heaps;
+	size_t nheaps;
+	size_t mappedsz;
+	size_t allocsz;
+	size_t freesz;
+	size_t peaksz;
+	size_t nhuge;
+	size_t hugesz;
+
+	size_t mmapThreshold;
+
+	handle_t mutex;
+} malloc_common;
+
+
+static inline size_t malloc_blockSize(block_t *block)
+{
+	return block->size & ~(size_t)(BLOCK_FREE | BLOCK_MMAPED);
+}
+
+
+static inline block_t *malloc_blockNext(block_t *block)
+{
+	return (block_t *) ((uintptr_t) block + malloc_blockSize(block));
+}
+
+
+static inline void *malloc_blockPtr(block_t *block)
+{
+	return (void *) ((uintptr_t) block + BLOCK_OVERHEAD);
+}
+
+
+static inline block_t *malloc_ptrBlock(void *ptr)
+{
+	return (block_t *) ((uintptr_t) ptr - BLOCK_OVERHEAD);
+}
+
+
+static inline unsigned int malloc_msb(size_t x)
+{
+	return sizeof(unsigned long) * __CHAR_BIT__ - 1 - __builtin_clzl(x);
+}
+
+
+static inline void malloc_mapping(size_t size, unsigned int *fl, unsigned int *sl)
+{
+	unsigned int msb;
+
+	if (size < TLSF_SMALL) {
+		*fl = 0;
+		*sl = size >> 3;
+	}
+	else {
+		msb = malloc_msb(size);
+		*fl = msb - TLSF_SMALL_LOG2 + 1;
+		*sl = (size >> (msb - TLSF_SLI_LOG2)) & (TLSF_SLI - 1);
+	}
+}
+
+
+static void _malloc_blockInsert(block_t *block)
+{
+	unsigned int fl, sl;
+
+	malloc_mapping(malloc_blockSize(block), &fl, &sl);
+
+	block->prevFree = NULL;
+	block->nextFree = malloc_common.blocks[fl][sl];
+	if (block->nextFree != NULL)
+		block->nextFree->prevFree = block;
+
+	malloc_common.blocks[fl][sl] = block;
+	malloc_common.slmap[fl] |= 1U << sl;
+	malloc_common.flmap |= 1U << fl;
+}
+
+
+static void _malloc_blockRemove(block_t *block)
+{
+	unsigned int fl, sl;
+
+	malloc_mapping(malloc_blockSize(block), &fl, &sl);
+
+	if (block->prevFree != NULL)
+		block->prevFree->nextFree = block->nextFree;
+	else
+		malloc_common.blocks[fl][sl] = block->nextFree;
+
+	if (block->nextFree != NULL)
+		block->nextFree->prevFree = block->prevFree;
+
+	if (malloc_common.blocks[fl][sl] == NULL) {
+		malloc_common.slmap[fl] &= ~(1U << sl);
+		if (malloc_common.slmap[fl] == 0)
+			malloc_common.flmap &= ~(1U << fl);
+	}
+}
+
+
+/* Returns the head of the first list holding only blocks of at least size bytes */
+static block_t *_malloc_blockFind(size_t size)
+{
+	unsigned int fl, sl;
+	uint32_t map;
+
+	/* Round up to the next list, so that no list has to be searched */
+	if (size >= TLSF_SMALL)
+		size += ((size_t)1 << (malloc_msb(size) - TLSF_SLI_LOG2)) - 1;
+
+	malloc_mapping(size, &fl, &sl);
+	if (fl >= TLSF_FLI)
+		return NULL;
+
+	map = malloc_common.slmap[fl] & (~0U << sl);
+	if (map == 0) {
+		map = malloc_common.flmap & (~0U << (fl + 1));
+		if (map == 0)
+			return NULL;
+
+		fl = __builtin_ctz(map);
+		map = malloc_common.slmap[fl];
+	}
+
+	return malloc_common.blocks[fl][__builtin_ctz(map)];
+}
+
+
+static void _malloc_blockFree(block_t *block)
+{
+	block_t *next = malloc_blockNext(block), *prev = block->prevPhys;
+
+	malloc_common.allocsz -= malloc_blockSize(block);
+	malloc_common.freesz += malloc_blockSize(block);
+
+	block->size |= BLOCK_FREE;
+
+	if (next->size & BLOCK_FREE) {
+		_malloc_blockRemove(next);
+		block->size += malloc_blockSize(next);
+		next = malloc_blockNext(block);
+	}
+
+	if ((prev != NULL) && (prev->size & BLOCK_FREE)) {
+		_malloc_blockRemove(prev);
+		prev->size += malloc_blockSize(block);
+		block = prev;
+	}
+
+	next->prevPhys = block;
+	_malloc_blockInsert(block);
+}
+
+
+/* Returns the tail of the used block beyond size bytes to the pool */
+static void _malloc_blockSplit(block_t *block, size_t size)
+{
+	block_t *rest;
+
+	if (malloc_blockSize(block) < size + BLOCK_MIN_SIZE)
+		return;
+
+	rest = (block_t *) ((uintptr_t) block + size);
+	rest->size = malloc_blockSize(block) - size;
+	rest->prevPhys = block;
+	malloc_blockNext(rest)->prevPhys = rest;
+
+	block->size = size;
+	_malloc_blockFree(rest);
+}
+
+
+static void _malloc_blockUse(block_t *block)
+{
+	_malloc_blockRemove(block);
+	block->size &= ~BLOCK_FREE;
+
+	malloc_common.freesz -= malloc_blockSize(block);
+	malloc_common.allocsz += malloc_blockSize(block);
+	malloc_common.peaksz = max(malloc_common.peaksz, malloc_common.allocsz);
+}
+
+
+static int _malloc_heapAdd(size_t heapsz)
+{
+	block_t *block, *sentinel;
+	heap_t *heap;
+
+	heapsz = CEIL(heapsz, _PAGE_SIZE);
+	if (heapsz >= ((size_t)1 << TLSF_FLI_MAX))
+		return -1;
+
+	heap = mmap(NULL, heapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (heap == MAP_FAILED)
+		return -1;
+
+	heap->size = heapsz;
+	LIST_ADD(&malloc_common.heaps, heap);
+	malloc_common.nheaps++;
+	malloc_common.mappedsz += heapsz;
+
+	/* Used block of zero size at the end of the heap stops joining */
+	block = (block_t *) ((uintptr_t) heap + HEAP_OVERHEAD);
+	block->prevPhys = NULL;
+	block->size = heapsz - HEAP_OVERHEAD - BLOCK_OVERHEAD;
+
+	sentinel = malloc_blockNext(block);
+	sentinel->prevPhys = block;
+	sentinel->size = 0;
+
+	malloc_common.allocsz += malloc_blockSize(block);
+	_malloc_blockFree(block);
+
+	return 0;
+}
+
+
+static void *_malloc_alloc(size_t size)
+{
+	block_t *block;
+
+	if ((block = _malloc_blockFind(size)) == NULL) {
+		/* Leave room for rounding the size up to the next list */
+		if (_malloc_heapAdd(max((size_t)MALLOC_HEAP_SIZE, HEAP_OVERHEAD + size + (size >> TLSF_SLI_LOG2) + BLOCK_OVERHEAD)) < 0)
+			return NULL;
+
+		block = _malloc_blockFind(size);
+	}
+
+	_malloc_blockUse(block);
+	_malloc_blockSplit(block, size);
+
+	return malloc_blockPtr(block);
+}
+
+
+static void *malloc_allocHuge(size_t size)
+{
+	size_t mapsz = CEIL(size, _PAGE_SIZE);
+	block_t *block;
+
+	block = mmap(NULL, mapsz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED)
+		return NULL;
+
+	block->prevPhys = NULL;
+	block->size = mapsz | BLOCK_MMAPED;
+
+	mutexLock(malloc_common.mutex);
+	malloc_common.nhuge++;
+	malloc_common.hugesz += mapsz;
+	mutexUnlock(malloc_common.mutex);
+
+	return malloc_blockPtr(block);
+}
+
+
+static void malloc_freeHuge(block_t *block)
+{
+	size_t mapsz = malloc_blockSize(block);
+
+	mutexLock(malloc_common.mutex);
+	malloc_common.nhuge--;
+	malloc_common.hugesz -= mapsz;
+	mutexUnlock(malloc_common.mutex);
+
+	munmap(block, mapsz);
+}
+
+
+/* Takes the block size (overhead included and aligned) */
+static void *malloc_allocBlock(size_t size)
+{
+	void *ptr;
+
+	if (size >= malloc_common.mmapThreshold) {
+		ptr = malloc_allocHuge(size);
+	}
+	else {
+		mutexLock(malloc_common.mutex);
+		ptr = _malloc_alloc(size);
+		mutexUnlock(malloc_common.mutex);
+	}
+
+	if (ptr == NULL) {
+		errno = ENOMEM;
+	}
+
+	return ptr;
+}
+
+
+static inline int malloc_blockSizeGet(size_t *size)
+{
+	if ((*size + BLOCK_OVERHEAD) < *size) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	*size = CEIL(max(*size + BLOCK_OVERHEAD, BLOCK_MIN_SIZE), 8);
+
+	return 0;
+}
+
+
+size_t malloc_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
+
+	return malloc_blockSize(malloc_ptrBlock(ptr)) - BLOCK_OVERHEAD;
+}
+
+
+void *malloc(size_t size)
+{
+	if (size == 0)
+		return NULL;
+
+	if (malloc_blockSizeGet(&size) < 0)
+		return NULL;
+
+	return malloc_allocBlock(size);
+}
+
+
+void *calloc(size_t nitems, size_t size)
+{
+	void *ptr;
+
+	if ((nitems != 0) && (size > SIZE_MAX / nitems)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ((ptr = malloc(nitems * size)) == NULL)
+		return NULL;
+
+	/* Dedicated mappings are always fresh */
+	if (!(malloc_ptrBlock(ptr)->size & BLOCK_MMAPED))
+		memset(ptr, 0, nitems * size);
+
+	return ptr;
+}
+
+
+void free(void *ptr)
+{
+	block_t *block;
+
+	if (ptr == NULL)
+		return;
+
+	block = malloc_ptrBlock(ptr);
+
+	if (block->size & BLOCK_FREE) {
+		debug("Double free detected\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	if (block->size & BLOCK_MMAPED) {
+		malloc_freeHuge(block);
+		return;
+	}
+
+	mutexLock(malloc_common.mutex);
+	_malloc_blockFree(block);
+	mutexUnlock(malloc_common.mutex);
+}
+
+
+void free_sized(void *ptr, size_t size)
+{
+	if ((ptr != NULL) && (size > malloc_usable_size(ptr))) {
+		debug("free_sized: size does not match the allocation\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	free(ptr);
+}
+
+
+void free_aligned_sized(void *ptr, size_t alignment, size_t size)
+{
+	if ((ptr != NULL) && ((((uintptr_t) ptr & (alignment - 1)) != 0) || (size > malloc_usable_size(ptr)))) {
+		debug("free_aligned_sized: alignment or size does not match the allocation\n");
+		_exit(EX_SOFTWARE);
+	}
+
+	free(ptr);
+}
+
+
+void free_batch(void **ptrs, size_t n)
+{
+	block_t *block;
+	size_t i;
+
+	mutexLock(malloc_common.mutex);
+	for (i = 0; i < n; ++i) {
+		if (ptrs[i] == NULL)
+			continue;
+
+		block = malloc_ptrBlock(ptrs[i]);
+
+		if (block->size & BLOCK_FREE) {
+			debug("Double free detected\n");
+			_exit(EX_SOFTWARE);
+		}
+
+		if (block->size & BLOCK_MMAPED) {
+			mutexUnlock(malloc_common.mutex);
+			malloc_freeHuge(block);
+			mutexLock(malloc_common.mutex);
+			continue;
+		}
+
+		_malloc_blockFree(block);
+	}
+	mutexUnlock(malloc_common.mutex);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+	block_t *block, *next;
+	size_t blocksz;
+	void *p;
+
+	if (ptr == NULL)
+		return malloc(size);
+
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+
+	if (malloc_blockSizeGet(&size) < 0)
+		return NULL;
+
+	block = malloc_ptrBlock(ptr);
+	blocksz = malloc_blockSize(block);
+
+	if (block->size & BLOCK_MMAPED) {
+		if ((size <= blocksz) && (size >= malloc_common.mmapThreshold))
+			return ptr;
+	}
+	else if (size < malloc_common.mmapThreshold) {
+		mutexLock(malloc_common.mutex);
+		next = malloc_blockNext(block);
+		if ((size > blocksz) && (next->size & BLOCK_FREE) && (blocksz + malloc_blockSize(next) >= size)) {
+			_malloc_blockUse(next);
+			block->size += malloc_blockSize(next);
+			malloc_blockNext(block)->prevPhys = block;
+		}
+
+		if (size <= malloc_blockSize(block)) {
+			_malloc_blockSplit(block, size);
+			mutexUnlock(malloc_common.mutex);
+			return ptr;
+		}
+		mutexUnlock(malloc_common.mutex);
+	}
+
+	if ((p = malloc_allocBlock(size)) == NULL)
+		return NULL;
+
+	memcpy(p, ptr, min(size, blocksz) - BLOCK_OVERHEAD);
+	free(ptr);
+
+	return p;
+}
+
+
+static void *malloc_aligned(size_t alignment, size_t size)
+{
+	block_t *block, *aligned;
+	uintptr_t ptr;
+	size_t lead;
+
+	if (alignment <= 8)
+		return malloc(size);
+
+	if (size == 0)
+		return NULL;
+
+	if ((malloc_blockSizeGet(&size) < 0) || ((size + alignment + BLOCK_MIN_SIZE) < size)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Worst case needs room for a leading free block and the alignment slack */
+	mutexLock(malloc_common.mutex);
+	ptr = (uintptr_t) _malloc_alloc(size + alignment + BLOCK_MIN_SIZE);
+	if (ptr == 0) {
+		mutexUnlock(malloc_common.mutex);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	block = malloc_ptrBlock((void *) ptr);
+
+	if ((ptr & (alignment - 1)) != 0) {
+		lead = CEIL(ptr, alignment) - ptr;
+		while (lead < BLOCK_MIN_SIZE)
+			lead += alignment;
+
+		aligned = (block_t *) ((uintptr_t) block + lead);
+		aligned->size = malloc_blockSize(block) - lead;
+		aligned->prevPhys = block;
+		malloc_blockNext(aligned)->prevPhys = aligned;
+
+		block->size = lead;
+		_malloc_blockFree(block);
+
+		block = aligned;
+	}
+
+	_malloc_blockSplit(block, size);
+	mutexUnlock(malloc_common.mutex);
+
+	return malloc_blockPtr(block);
+}
+
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+	int err = errno;
+
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0) || ((alignment % sizeof(void *)) != 0)) {
+		return EINVAL;
+	}
+
+	ptr = malloc_aligned(alignment, size);
+	if ((ptr == NULL) && (size != 0)) {
+		errno = err;
+		return ENOMEM;
+	}
+
+	*memptr = ptr;
+
+	return 0;
+}
+
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	if ((alignment == 0) || ((alignment & (alignment - 1)) != 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return malloc_aligned(alignment, size);
+}
+
+
+void *memalign(size_t alignment, size_t size)
+{
+	return aligned_alloc(alignment, size);
+}
+
+
+void _malloc_threadCleanup(void)
+{
+}
+
+
+static inline int malloc_heapIsEmpty(heap_t *heap)
+{
+	block_t *block = (block_t *) ((uintptr_t) heap + HEAP_OVERHEAD);
+
+	return ((block->size & BLOCK_FREE) && (malloc_blockNext(block)->size == 0));
+}
+
+
+/* Heaps are never released by free(), so that it doesn't depend on munmap() latency */
+int malloc_trim(size_t pad)
+{
+	heap_t *heap, *next;
+	block_t *block;
+	size_t emptysz = 0, n;
+	int released = 0;
+
+	mutexLock(malloc_common.mutex);
+	for (n = malloc_common.nheaps, heap = malloc_common.heaps; n > 0; --n, heap = next) {
+		next = heap->next;
+
+		if (!malloc_heapIsEmpty(heap))
+			continue;
+
+		if (emptysz + heap->size <= pad) {
+			emptysz += heap->size;
+			continue;
+		}
+
+		block = (block_t *) ((uintptr_t) heap + HEAP_OVERHEAD);
+		_malloc_blockRemove(block);
+		malloc_common.freesz -= malloc_blockSize(block);
+		malloc_common.nheaps--;
+		malloc_common.mappedsz -= heap->size;
+
+		LIST_REMOVE(&malloc_common.heaps, heap);
+		munmap(heap, heap->size);
+		released = 1;
+	}
+	mutexUnlock(malloc_common.mutex);
+
+	return released;
+}
+
+
+int mallopt(int param, int value)
+{
+	if (value < 0)
+		return 0;
+
+	switch (param) {
+		case M_MMAP_THRESHOLD:
+			if (value <= TLSF_SMALL)
+				return 0;
+
+			malloc_common.mmapThreshold = value;
+			break;
+
+		default:
+			return 0;
+	}
+
+	return 1;
+}
+
+
+struct mallinfo2 mallinfo2(void)
+{
+	struct mallinfo2 info;
+	block_t *block;
+	heap_t *heap;
+	int fl, sl;
+
+	memset(&info, 0, sizeof(info));
+
+	mutexLock(malloc_common.mutex);
+	for (fl = 0; fl < TLSF_FLI; ++fl) {
+		for (sl = 0; sl < TLSF_SLI; ++sl) {
+			for (block = malloc_common.blocks[fl][sl]; block != NULL; block = block->nextFree) {
+				info.ordblks++;
+				if (fl == 0) {
+					info.smblks++;
+					info.fsmblks += malloc_blockSize(block);
+				}
+			}
+		}
+	}
+
+	if ((heap = malloc_common.heaps) != NULL) {
+		do {
+			if (malloc_heapIsEmpty(heap))
+				info.keepcost += heap->size;
+		} while ((heap = heap->next) != malloc_common.heaps);
+	}
+
+	info.arena = malloc_common.mappedsz;
+	info.hblks = malloc_common.nhuge;
+	info.hblkhd = malloc_common.hugesz;
+	info.usmblks = malloc_common.peaksz;
+	info.uordblks = malloc_common.allocsz + malloc_common.hugesz;
+	info.fordblks = malloc_common.freesz;
+	mutexUnlock(malloc_common.mutex);
+
+	return info;
+}
+
+
+void malloc_stats(void)
+{
+	struct mallinfo2 info = mallinfo2();
+
+	fprintf(stderr, "heaps            = %10zu\n", malloc_common.nheaps);
+	fprintf(stderr, "system bytes     = %10zu\n", info.arena);
+	fprintf(stderr, "max system bytes = %10zu\n", info.usmblks);
+	fprintf(stderr, "in use bytes     = %10zu\n", info.uordblks);
+	fprintf(stderr, "free bytes       = %10zu\n", info.fordblks);
+	fprintf(stderr, "free blocks      = %10zu\n", info.ordblks);
+	fprintf(stderr, "empty heap bytes = %10zu\n", info.keepcost);
+	fprintf(stderr, "mmap regions     = %10zu\n", info.hblks);
+	fprintf(stderr, "mmap bytes       = %10zu\n", info.hblkhd);
+}
+
+
+int malloc_info(int options, FILE *stream)
+{
+	struct mallinfo2 info;
+	size_t count[TLSF_SLI], total[TLSF_SLI], from;
+	block_t *block;
+	int fl, sl;
+
+	if (options != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fprintf(stream, "<malloc version=\"1\">\n<heap nr=\"0\">\n<sizes>\n");
+
+	for (fl = 0; fl < TLSF_FLI; ++fl) {
+		/* Copy one first level out, so it can be printed without holding the lock */
+		mutexLock(malloc_common.mutex);
+		for (sl = 0; sl < TLSF_SLI; ++sl) {
+			count[sl] = 0;
+			total[sl] = 0;
+			for (block = malloc_common.blocks[fl][sl]; block != NULL; block = block->nextFree) {
+				count[sl]++;
+				total[sl] += malloc_blockSize(block);
+			}
+		}
+		mutexUnlock(malloc_common.mutex);
+
+		for (sl = 0; sl < TLSF_SLI; ++sl) {
+			if (count[sl] == 0)
+				continue;
+
+			if (fl == 0)
+				from = (size_t)sl << 3;
+			else
+				from = (size_t)(TLSF_SLI + sl) << (fl - 1 + TLSF_SMALL_LOG2 - TLSF_SLI_LOG2);
+
+			fprintf(stream, "<size from=\"%zu\" total=\"%zu\" count=\"%zu\"/>\n", from, total[sl], count[sl]);
+		}
+	}
+
+	info = mallinfo2();
+
+	fprintf(stream, "</sizes>\n");
+	fprintf(stream, "<total type=\"heap\" count=\"%zu\" size=\"%zu\"/>\n", malloc_common.nheaps, info.arena);
+	fprintf(stream, "<total type=\"mmap\" count=\"%zu\" size=\"%zu\"/>\n", info.hblks, info.hblkhd);
+	fprintf(stream, "<system type=\"current\" size=\"%zu\"/>\n", info.arena + info.hblkhd);
+	fprintf(stream, "<aspace type=\"inuse\" size=\"%zu\"/>\n", info.uordblks);
+	fprintf(stream, "<aspace type=\"free\" size=\"%zu\"/>\n", info.fordblks);
+	fprintf(stream, "</heap>\n</malloc>\n");
+
+	return 0;
+}
+
+
+int malloc_profile(size_t rate)
+{
+	/* Sampling is not supported, it would add unbounded work to malloc() */
+	if (rate == 0)
+		return 0;
+
+	errno = ENOSYS;
+	return -1;
+}
+
+
+size_t malloc_profileRead(malloc_sample_t *buf, size_t n)
+{
+	(void)buf;
+	(void)n;
+
+	return 0;
+}
+
+
+int malloc_profileDump(FILE *stream)
+{
+	(void)stream;
+
+	return 0;
+}
+
+
+void _malloc_init(void)
+{
+	malloc_common.flmap = 0;
+	memset(malloc_common.slmap, 0, sizeof(malloc_common.slmap));
+	memset(malloc_common.blocks, 0, sizeof(malloc_common.blocks));
+
+	malloc_common.heaps = NULL;
+	malloc_common.nheaps = 0;
+	malloc_common.mappedsz = 0;
+	malloc_common.allocsz = 0;
+	malloc_common.freesz = 0;
+	malloc_common.peaksz = 0;
+	malloc_common.nhuge = 0;
+	malloc_common.hugesz = 0;
+	malloc_common.mmapThreshold = MALLOC_MMAP_THRESHOLD;
+
+	mutexCreate(&malloc_common.mutex);
+
+	if (MALLOC_POOL_SIZE != 0)
+		_malloc_heapAdd(MALLOC_POOL_SIZE);
+}
+
+
+#define ASSERT(cond, ...) do {					\
+		if (!(cond)) {					\
+			printf(__VA_ARGS__);			\
+			for (;;) ;				\
+		}						\
+	} while (0)
+
+
+static void malloc_test_heap(heap_t *heap)
+{
+	block_t *block = (block_t *) ((uintptr_t) heap + HEAP_OVERHEAD), *prev = NULL;
+	unsigned int fl, sl;
+
+	for (; block->size != 0; prev = block, block = malloc_blockNext(block)) {
+		ASSERT(block->prevPhys == prev, "malloc_tlsf: invalid prevPhys\n");
+		ASSERT((uintptr_t) block < (uintptr_t) heap + heap->size, "malloc_tlsf: block beyond heap\n");
+
+		if (block->size & BLOCK_FREE) {
+			ASSERT((prev == NULL) || !(prev->size & BLOCK_FREE), "malloc_tlsf: unmerged free blocks\n");
+
+			malloc_mapping(malloc_blockSize(block), &fl, &sl);
+			ASSERT(malloc_common.slmap[fl] & (1U << sl), "malloc_tlsf: slmap bit %u/%u not set\n", fl, sl);
+		}
+	}
+
+	ASSERT(block->prevPhys == prev, "malloc_tlsf: invalid sentinel prevPhys\n");
+}
+
+
+void malloc_test(void)
+{
+	heap_t *heap;
+	block_t *block;
+	int fl, sl;
+
+	mutexLock(malloc_common.mutex);
+
+	for (fl = 0; fl < TLSF_FLI; ++fl) {
+		for (sl = 0; sl < TLSF_SLI; ++sl) {
+			ASSERT(!(malloc_common.slmap[fl] & (1U << sl)) == (malloc_common.blocks[fl][sl] == NULL),
+				"malloc_tlsf: slmap bit %d/%d does not match list\n", fl, sl);
+
+			for (block = malloc_common.blocks[fl][sl]; block != NULL; block = block->nextFree)
+				ASSERT(block->size & BLOCK_FREE, "malloc_tlsf: used block in free list\n");
+		}
+
+		ASSERT(!(malloc_common.flmap & (1U << fl)) == (malloc_common.slmap[fl] == 0), "malloc_tlsf: flmap bit %d does not match slmap\n", fl);
+	}
+
+	if ((heap = malloc_common.heaps) != NULL) {
+		do {
+			malloc_test_heap(heap);
+		} while ((heap = heap->next) != malloc_common.heaps);
+	}
+
+	mutexUnlock(malloc_common.mutex);
+}
@@ -5,7 +5,7 @@
  *
  * stdlib/malloc_trivial - trivial dynamic memory allocator
  *
- * Copyright 2017 Phoenix Systems
+ * Copyright 2017, 2026 Phoenix Systems
  * Author: Pawel Pisarczyk, Andrzej Asztemborski
  *
  * This file is part of Phoenix-RTOS.
@@ -13,15 +13,31 @@
  * %LICENSE%
  */
 
-#include "assert.h"
-#include "stdlib.h"
-#include "sys/list.h"
-#include "sys/threads.h"
-#include "sys/mman.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/list.h>
+#include <sys/threads.h>
+#include <sys/mman.h>
+
+#include <arch.h>
 
 
 #define CEIL(x, s)  (((x) + (s) - 1) & ~((s) - 1))
 
+/* Heaps are mapped at least this big, bigger requests get a heap of their own */
+#ifndef MALLOC_TRIVIAL_HEAP
+#define MALLOC_TRIVIAL_HEAP  (64 * 1024)
+#endif
+
+/* Chunk size is kept in the header and in the footer, lowest bit marks used chunks */
+#define CHUNK_USED           1
+#define CHUNK_OVERHEAD       (2 * sizeof(size_t))
+#define CHUNK_MIN            (2 * sizeof(void *))
+#define CHUNK_SIZE(c)        ((c)->size & ~(size_t)CHUNK_USED)
+#define CHUNK_FOOTER(c)      (*(size_t *)((c)->userspace + CHUNK_SIZE(c)))
+
 
 typedef struct _chunk_t {
 	size_t size;
@@ -36,6 +52,7 @@ typedef struct _chunk_t {
 } chunk_t;
 
 
+/* Heap space is enclosed by used guards, so that neighbours are found by boundary tags alone */
 typedef struct _heap_t {
 	struct _heap_t *next;
 	struct _heap_t *prev;
@@ -43,29 +60,86 @@ typedef struct _heap_t {
 	size_t size;
 	size_t maxchunk;
 	chunk_t *chunks;
+	size_t guard;
 } heap_t;
 
 
-struct {
+static struct {
 	handle_t mutex;
 	heap_t *heaps;
 } malloc_common;
 
 
+static inline void malloc_chunkSetSize(chunk_t *chunk, size_t size)
+{
+	chunk->size = size;
+	CHUNK_FOOTER(chunk) = size;
+}
+
+
+static chunk_t *malloc_chunkPrev(chunk_t *chunk)
+{
+	size_t size = *((size_t *)chunk - 1);
+
+	if (size & CHUNK_USED)
+		return NULL;
+
+	return (chunk_t *)((char *)chunk - size - CHUNK_OVERHEAD);
+}
+
+
+static chunk_t *malloc_chunkNext(chunk_t *chunk)
+{
+	chunk_t *next = (chunk_t *)(chunk->userspace + CHUNK_SIZE(chunk) + sizeof(size_t));
+
+	if (next->size & CHUNK_USED)
+		return NULL;
+
+	return next;
+}
+
+
+/* Size of the chunk spanning the whole heap */
+static inline size_t malloc_heapSpace(heap_t *heap)
+{
+	return (heap->size - sizeof(heap_t) - CHUNK_OVERHEAD - sizeof(size_t)) & ~(size_t)7;
+}
+
+
+static void _malloc_heapUpdate(heap_t *heap)
+{
+	chunk_t *chunk;
+
+	heap->maxchunk = 0;
+
+	if ((chunk = heap->chunks) == NULL)
+		return;
+
+	do {
+		if (chunk->size > heap->maxchunk)
+			heap->maxchunk = chunk->size;
+		chunk = chunk->next;
+	} while (chunk != heap->chunks);
+}
+
+
 static heap_t *_malloc_heapCreate(size_t size)
 {
 	heap_t *heap;
 	chunk_t *chunk;
 
 	heap = mmap((void *)0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (heap == NULL) {
+	if (heap == MAP_FAILED) {
 		return NULL;
 	}
 
 	heap->size = size;
+	heap->chunks = NULL;
+	heap->guard = CHUNK_USED;
 	chunk = (chunk_t *)(heap + 1);
 
-	CHUNK_SETSIZE(chunk, (heap->size - sizeof(heap_t) - 2 * sizeof(size_t)) & ~7);
+	malloc_chunkSetSize(chunk, malloc_heapSpace(heap));
+	((chunk_t *)(chunk->userspace + chunk->size + sizeof(size_t)))->size = CHUNK_USED;
 	heap->maxchunk = chunk->size;
 
 	LIST_ADD(&heap->chunks, chunk);
@@ -75,32 +149,52 @@ static heap_t *_malloc_heapCreate(size_t size)
 }
 
 
-static void *_malloc_heapDestroy(heap_t *heap)
+static void _malloc_heapDestroy(heap_t *heap)
 {
+	LIST_REMOVE(&malloc_common.heaps, heap);
 	munmap(heap, heap->size);
+}
+
+
+static heap_t *_malloc_heapFind(chunk_t *chunk)
+{
+	heap_t *heap = malloc_common.heaps;
+
+	do {
+		if (((uintptr_t)chunk > (uintptr_t)heap) && ((uintptr_t)chunk < (uintptr_t)heap + heap->size))
+			return heap;
+		heap = heap->next;
+	} while (heap != malloc_common.heaps);
+
 	return NULL;
 }
 
 
-static void *_malloc_heapAlloc(size_t size)
+static chunk_t *_malloc_heapAlloc(heap_t *heap, size_t size)
 {
-	heap_t *heap;
 	chunk_t *chunk, *remainder;
 
 	if ((chunk = heap->chunks) == NULL)
 		return NULL;
 
+	/* First fit */
+	while (chunk->size < size) {
+		if ((chunk = chunk->next) == heap->chunks)
+			return NULL;
+	}
+
 	LIST_REMOVE(&heap->chunks, chunk);
 
-	if (chunk->size > size) {
-		remainder = (chunk_t *)(chunk->userspace + chunk->size + sizeof(size_t));
+	if (chunk->size >= size + CHUNK_OVERHEAD + CHUNK_MIN) {
+		remainder = (chunk_t *)(chunk->userspace + size + sizeof(size_t));
 
-		CHUNK_SETSIZE(remainder, chunk->size - size - 2 * sizeof(size_t));
-		CHUNK_SETSIZE(chunk, size);
+		malloc_chunkSetSize(remainder, chunk->size - size - CHUNK_OVERHEAD);
+		malloc_chunkSetSize(chunk, size);
 
 		LIST_ADD(&heap->chunks, remainder);
 	}
 
+	malloc_chunkSetSize(chunk, chunk->size | CHUNK_USED);
 	_malloc_heapUpdate(heap);
 
 	return chunk;
@@ -111,58 +205,92 @@ static void _malloc_heapRelease(heap_t *heap, chunk_t *chunk)
 {
 	chunk_t *prev, *next;
 
-	prev = CHUNK_PREV(chunk);
-	if ((prev != NULL) && ((prev->size & 1) == 0)) {
+	malloc_chunkSetSize(chunk, CHUNK_SIZE(chunk));
+
+	if ((prev = malloc_chunkPrev(chunk)) != NULL) {
 		LIST_REMOVE(&heap->chunks, prev);
-		CHUNK_SETSIZE(prev, prev->size + chunk->size + 2 * sizeof(size_t));
+		malloc_chunkSetSize(prev, prev->size + chunk->size + CHUNK_OVERHEAD);
 		chunk = prev;
 	}
 
-	next = CHUNK_NEXT(chunk);
-	if ((next != NULL) && ((next->size & 1) == 0)) {
+	if ((next = malloc_chunkNext(chunk)) != NULL) {
 		LIST_REMOVE(&heap->chunks, next);
-		CHUNK_SETSIZE(chunk, chunk->size + next->size + 2 * sizeof(size_t));
+		malloc_chunkSetSize(chunk, chunk->size + next->size + CHUNK_OVERHEAD);
 	}
 
 	LIST_ADD(&heap->chunks, chunk);
+
+	if (chunk->size > heap->maxchunk)
+		heap->maxchunk = chunk->size;
+
+	/* Whole heap is free, the last one is kept */
+	if ((chunk->size == malloc_heapSpace(heap)) && (heap->next != heap))
+		_malloc_heapDestroy(heap);
 }
 
 
-void *malloc(size_t size)
+static chunk_t *_malloc_alloc(size_t size)
 {
 	heap_t *heap;
-	void *m;
+	size_t heapsz;
+
+	if ((heap = malloc_common.heaps) != NULL) {
+		do {
+			if (heap->maxchunk >= size)
+				return _malloc_heapAlloc(heap, size);
+			heap = heap->next;
+		} while (heap != malloc_common.heaps);
+	}
+
+	heapsz = CEIL(sizeof(heap_t) + size + CHUNK_OVERHEAD + sizeof(size_t), _PAGE_SIZE);
+	if (heapsz < size)
+		return NULL;
+
+	if ((heap = _malloc_heapCreate((heapsz < MALLOC_TRIVIAL_HEAP) ? MALLOC_TRIVIAL_HEAP : heapsz)) == NULL)
+		return NULL;
+
+	return _malloc_heapAlloc(heap, size);
+}
+
+
+void *malloc(size_t size)
+{
+	chunk_t *chunk;
 
 	if (!size)
 		return NULL;
 
-	size = CEIL(size, 8);
+	if (size > SIZE_MAX / 2) {
+		errno = ENOMEM;
+		return NULL;
+	}
 
-	mutexLock(malloc_common.mutex);
-	if ((heap = LIST_FIND(malloc_common.heaps, size)) == NULL)
-		heap = malloc_heapCreate();
+	size = (size < CHUNK_MIN) ? CHUNK_MIN : CEIL(size, 8);
 
-	m = _malloc_heapAlloc(size);
+	mutexLock(malloc_common.mutex);
+	chunk = _malloc_alloc(size);
 	mutexUnlock(malloc_common.mutex);
 
-	if (m == NULL) {
+	if (chunk == NULL) {
 		errno = ENOMEM;
+		return NULL;
 	}
 
-	return m;
+	return chunk->userspace;
 }
 
 
 void free(void *ptr)
 {
-	heap_t *heap;
 	chunk_t *chunk;
 
-	mutexLock(malloc_common.mutex);
+	if (ptr == NULL)
+		return;
 
-	chunk = ptr - sizeof(size_t);
-	heap = _malloc_heapFind(chunk);
-	_malloc_heapRelease(heap, chunk);
+	chunk = (chunk_t *)((char *)ptr - sizeof(size_t));
+
+	mutexLock(malloc_common.mutex);
+	_malloc_heapRelease(_malloc_heapFind(chunk), chunk);
 	mutexUnlock(malloc_common.mutex);
 }
 
@@ -171,19 +299,24 @@ void *calloc(size_t nmemb, size_t size)
 {
 	void *m;
 
-	if ((m = malloc(CEIL(nmemb * size, 8))) == NULL)
+	if ((size != 0) && (nmemb > SIZE_MAX / size)) {
+		errno = ENOMEM;
 		return NULL;
+	}
 
-	memset(m, 0, CEIL(nmemb * size, 8));
+	if ((m = malloc(nmemb * size)) == NULL)
+		return NULL;
+
+	memset(m, 0, nmemb * size);
 	return m;
 }
 
 
 void *realloc(void *ptr, size_t size)
 {
-	void *result;
 	chunk_t *chunk, *right, *newchunk;
 	heap_t *heap;
+	size_t chunksz;
 
 	if (ptr == NULL)
 		return malloc(size);
@@ -193,40 +326,57 @@ void *realloc(void *ptr, size_t size)
 		return NULL;
 	}
 
-	size = CEIL(size, 8);
-
-	mutexLock(malloc_common.mutex);
-	chunk = ptr - sizeof(chunk_t);
-	if (chunk->size == size) {
-		mutexUnlock(malloc_common.mutex);
-		return ptr;
+	if (size > SIZE_MAX / 2) {
+		errno = ENOMEM;
+		return NULL;
 	}
 
+	size = (size < CHUNK_MIN) ? CHUNK_MIN : CEIL(size, 8);
+
+	mutexLock(malloc_common.mutex);
+	chunk = (chunk_t *)((char *)ptr - sizeof(size_t));
+	chunksz = CHUNK_SIZE(chunk);
 	heap = _malloc_heapFind(chunk);
 
-	if (size > chunk->size) {
-		right = CHUNK_NEXT(chunk);
-		if ((right != NULL) && ((right->size & 1) == 0) && (chunk->size + right->size >= size)) {
+	if (size > chunksz) {
+		right = malloc_chunkNext(chunk);
+		if ((right != NULL) && (chunksz + right->size + CHUNK_OVERHEAD >= size)) {
 			LIST_REMOVE(&heap->chunks, right);
-			CHUNK_SETSIZE(chunk, chunk->size + right->size);
+			malloc_chunkSetSize(chunk, (chunksz + right->size + CHUNK_OVERHEAD) | CHUNK_USED);
+			_malloc_heapUpdate(heap);
+			chunksz = CHUNK_SIZE(chunk);
 		}
 		else {
-			newchunk = _malloc_heapAllocate(heap, size);
-			memcpy(newchunk->userspace, chunk->userspace, chunk->size);
+			if ((newchunk = _malloc_alloc(size)) == NULL) {
+				mutexUnlock(malloc_common.mutex);
+				errno = ENOMEM;
+				return NULL;
+			}
+
+			memcpy(newchunk->userspace, chunk->userspace, chunksz);
 			_malloc_heapRelease(heap, chunk);
+			mutexUnlock(malloc_common.mutex);
+
+			return newchunk->userspace;
 		}
 	}
-	else if (size < chunk->size) {
-		newchunk = (chunk_t *)(chunk->userspace + chunk->size + sizeof(size_t));
-		CHUNK_SETSIZE(newchunk, chunk->size - size - 2 * sizeof(size_t));
-		CHUNK_SETSIZE(chunk, size);
-		LIST_ADD(&heap->chunks, newchunk);
+
+	/* Tail is given back if it makes a chunk, joining its free neighbour */
+	if (chunksz >= size + CHUNK_OVERHEAD + CHUNK_MIN) {
+		newchunk = (chunk_t *)(chunk->userspace + size + sizeof(size_t));
+		malloc_chunkSetSize(newchunk, (chunksz - size - CHUNK_OVERHEAD) | CHUNK_USED);
+		malloc_chunkSetSize(chunk, size | CHUNK_USED);
+		_malloc_heapRelease(heap, newchunk);
 	}
 
-	_malloc_heapUpdate(heap);
 	mutexUnlock(malloc_common.mutex);
 
-	return result;
+	return ptr;
+}
+
+
+void _malloc_threadCleanup(void)
+{
 }
 
 
@@ -164,7 +164,7 @@ static int get_digit_value(char byte, bool hex)
 }
 
 
-static const char *scan_number(const char *str, bool hex, char decimal_point, uint64_t limit, size_t *n_decimal, size_t *n_overflowed, uint64_t *out)
+static const char *scan_number(const char *str, bool hex, char decimal_point, uint64_t limit, size_t *n_decimal, size_t *n_overflowed, bool *truncated, uint64_t *out)
 {
 	const int base = hex ? 16 : 10;
 	uint64_t result = 0u;
@@ -189,8 +189,14 @@ static const char *scan_number(const char *str, bool hex, char decimal_point, ui
 				(*n_decimal)++;
 			}
 		}
-		else if (allow_dec != got_dec) {
-			(*n_overflowed)++;
+		else {
+			if (allow_dec != got_dec) {
+				(*n_overflowed)++;
+			}
+
+			if (dig != 0) {
+				*truncated = true;
+			}
 		}
 
 		str++;
@@ -336,6 +342,242 @@ static long double mul_exp2(long double in, int64_t exp)
 }
 
 
+/* Decimal fast path (Eisel-Lemire), 5^q for POW5_MIN <= q <= POW5_MAX as 128-bit fractions */
+#define POW5_MIN   (-342)
+#define POW5_MAX   308
+#define POW5_SMALL 27
+
+
+/* 5^(POW5_MIN + 27 * i), normalized to the most significant bit */
+static const uint64_t strtod_pow5[25][2] = {
+	{ 0xeef453d6923bd65aull, 0x113faa2906a13b3full },
+	{ 0xc1069cd4eabe89f8ull, 0x999ec0bb696e840aull },
+	{ 0x9becce62836ac577ull, 0x4ee367f9430aec32ull },
+	{ 0xfbe9141915d7a922ull, 0x4bf1ff9f0062baa8ull },
+	{ 0xcb7ddcdda26da268ull, 0xa9942f5dcf7dfd09ull },
+	{ 0xa46116538d0deb78ull, 0x52d9be85f074e608ull },
+	{ 0x84c8d4dfd2c63f3bull, 0x29ecd9f40041e073ull },
+	{ 0xd686619ba27255a2ull, 0xc80a537b0efefebdull },
+	{ 0xad4ab7112eb3929dull, 0x86c16c98d2c953c6ull },
+	{ 0x8bfbea76c619ef36ull, 0x57eb4edb3c55b65aull },
+	{ 0xe2280b6c20dd5232ull, 0x25c6da63c38de1b0ull },
+	{ 0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull },
+	{ 0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull },
+	{ 0xee6b280000000000ull, 0x0000000000000000ull },
+	{ 0xc097ce7bc90715b3ull, 0x4b9f100000000000ull },
+	{ 0x9b934c3b330c8577ull, 0x63cc55f49f88eb2full },
+	{ 0xfb5878494ace3a5full, 0x04ab48a04065c723ull },
+	{ 0xcb090c8001ab551cull, 0x5cadf5bfd3072cc5ull },
+	{ 0xa402b9c5a8d3a6e7ull, 0x5f16206c9c6209a6ull },
+	{ 0x847c9b5d7c2e09b7ull, 0x69956135febada11ull },
+	{ 0xd60b3bd56a5586f1ull, 0x8a71e223d8d3b074ull },
+	{ 0xace73cbfdc0bfb7bull, 0x636cc64d1001550bull },
+	{ 0x8bab8eefb6409c1aull, 0x1ad089b6c2f7548eull },
+	{ 0xe1a63853bbd26451ull, 0x5e7873f8a0396973ull },
+	{ 0xb6472e511c81471dull, 0xe0133fe4adf8e952ull }
+};
+
+
+/* Corrections (2 bits per power, biased by 1) of products of the above with strtod_pow5Small */
+static const uint32_t strtod_pow5Offsets[41] = {
+	0x6a6aa994u, 0x6a1a6565u, 0x9a9a5a56u, 0xa69a8555u, 0x99a9aa9au, 0x95655552u,
+	0x98a59656u, 0x565aa95au, 0xeba615a5u, 0xaaaaaa6au, 0x9a6a968au, 0x9169a69au,
+	0xa56956aau, 0x595499a5u, 0x55555555u, 0xa595aa19u, 0x499aa9aau, 0x55555555u,
+	0x55515555u, 0xab966556u, 0x555540fau, 0x04105555u, 0x55555555u, 0x55455555u,
+	0x55555555u, 0x99aaa155u, 0xa9696656u, 0xaaaa69a8u, 0x591aaa5au, 0x55556aa5u,
+	0x55954955u, 0x56666555u, 0x69a69a91u, 0xa86aa966u, 0xaaa9a9aau, 0x9aaa1a5au,
+	0xa56aaa6au, 0x5565564au, 0xa1955696u, 0xa969aaaau, 0x00146aabu
+};
+
+
+static const uint64_t strtod_pow5Small[POW5_SMALL] = {
+	1ull, 5ull, 25ull, 125ull, 625ull, 3125ull,
+	15625ull, 78125ull, 390625ull, 1953125ull, 9765625ull, 48828125ull,
+	244140625ull, 1220703125ull, 6103515625ull, 30517578125ull, 152587890625ull, 762939453125ull,
+	3814697265625ull, 19073486328125ull, 95367431640625ull, 476837158203125ull, 2384185791015625ull, 11920928955078125ull,
+	59604644775390625ull, 298023223876953125ull, 1490116119384765625ull
+};
+
+
+static const struct {
+	int32_t mantBits;
+	int32_t bias;
+	int32_t infPower;
+	int32_t minQ;     /* w * 10^q rounds to zero below */
+	int32_t maxQ;     /* and to infinity above */
+	int32_t minEvenQ; /* Ties are possible only in this range */
+	int32_t maxEvenQ;
+} strtod_formats[] = {
+	[TYPE_ID_FLT] = { 23, 127, 0xff, -65, 38, -17, 10 },
+	[TYPE_ID_DBL] = { 52, 1023, 0x7ff, POW5_MIN, POW5_MAX, -4, 23 },
+};
+
+
+static inline uint64_t strtod_umul128(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)a * b;
+
+	*hi = (uint64_t)(p >> 64);
+	return (uint64_t)p;
+#else
+	uint32_t aLo = (uint32_t)a, aHi = (uint32_t)(a >> 32);
+	uint32_t bLo = (uint32_t)b, bHi = (uint32_t)(b >> 32);
+	uint64_t b00 = (uint64_t)aLo * bLo, b01 = (uint64_t)aLo * bHi;
+	uint64_t b10 = (uint64_t)aHi * bLo, b11 = (uint64_t)aHi * bHi;
+	uint64_t mid1 = b10 + (b00 >> 32);
+	uint64_t mid2 = b01 + (uint32_t)mid1;
+
+	*hi = b11 + (mid1 >> 32) + (mid2 >> 32);
+	return (mid2 << 32) | (uint32_t)b00;
+#endif
+}
+
+
+/* Computes 5^q from the tables, res[0] holds the upper half */
+static void strtod_pow5Split(int32_t q, uint64_t *res)
+{
+	uint32_t i = q - POW5_MIN, base = i / POW5_SMALL, s;
+	const uint64_t *mul = strtod_pow5[base];
+	uint64_t m, p0, p1, p2, t;
+
+	m = strtod_pow5Small[i - base * POW5_SMALL];
+	if (m == 1) {
+		res[0] = mul[0];
+		res[1] = mul[1];
+		return;
+	}
+
+	p0 = strtod_umul128(mul[1], m, &t);
+	p1 = strtod_umul128(mul[0], m, &p2);
+	p1 += t;
+	p2 += (p1 < t);
+
+	/* p2 != 0 as m >= 5 */
+	s = __builtin_clzll(p2);
+	if (s != 0) {
+		p2 = (p2 << s) | (p1 >> (64 - s));
+		p1 = (p1 << s) | (p0 >> (64 - s));
+	}
+
+	res[0] = p2;
+	res[1] = p1 + ((strtod_pow5Offsets[i / 16] >> ((i % 16) << 1)) & 3) - 1;
+}
+
+
+/* Rounds w * 10^q to the nearest float/double, returns -1 if the result can't be decided this way */
+static int floatparse_eiselLemire(uint64_t w, int64_t q, uint8_t type, long double *out)
+{
+	const int32_t mantBits = strtod_formats[type].mantBits;
+	const uint64_t mask = UINT64_MAX >> (mantBits + 3);
+	uint64_t pow5[2], hi, lo, t, mant;
+	int32_t lz, upper, shift, power2;
+
+	if ((w == 0) || (q < strtod_formats[type].minQ)) {
+		mant = 0;
+		power2 = 0;
+	}
+	else if (q > strtod_formats[type].maxQ) {
+		mant = 0;
+		power2 = strtod_formats[type].infPower;
+	}
+	else {
+		strtod_pow5Split((int32_t)q, pow5);
+
+		lz = __builtin_clzll(w);
+		w <<= lz;
+		lo = strtod_umul128(w, pow5[0], &hi);
+
+		/* Bits below the mantissa may be off by the truncated part of 5^q, refine */
+		if ((hi & mask) == mask) {
+			strtod_umul128(w, pow5[1], &t);
+			lo += t;
+			hi += (t > lo);
+		}
+
+		/* 5^q is exact for small q, otherwise product may still be one below a rounding boundary */
+		if ((lo == UINT64_MAX) && ((q < -27) || (q > 55))) {
+			return -1;
+		}
+
+		upper = (int32_t)(hi >> 63);
+		shift = upper + 64 - mantBits - 3;
+		mant = hi >> shift;
+		power2 = (int32_t)((217706 * (int32_t)q) >> 16) + 63 + upper - lz + strtod_formats[type].bias;
+
+		if (power2 <= 0) {
+			/* Subnormal, ties can't happen here */
+			if (-power2 + 1 >= 64) {
+				mant = 0;
+				power2 = 0;
+			}
+			else {
+				mant >>= -power2 + 1;
+				mant += mant & 1;
+				mant >>= 1;
+				power2 = (mant < (1ull << mantBits)) ? 0 : 1;
+			}
+		}
+		else {
+			/* Exactly halfway, round to even */
+			if ((lo <= 1) && (q >= strtod_formats[type].minEvenQ) && (q <= strtod_formats[type].maxEvenQ) &&
+					((mant & 3) == 1) && ((mant << shift) == hi)) {
+				mant &= ~1ull;
+			}
+
+			mant += mant & 1;
+			mant >>= 1;
+			if (mant >= (2ull << mantBits)) {
+				mant = 1ull << mantBits;
+				power2++;
+			}
+
+			mant &= ~(1ull << mantBits);
+			if (power2 >= strtod_formats[type].infPower) {
+				mant = 0;
+				power2 = strtod_formats[type].infPower;
+			}
+		}
+	}
+
+	mant |= (uint64_t)power2 << mantBits;
+	if (type == TYPE_ID_FLT) {
+		union {
+			uint32_t i;
+			float f;
+		} u = { .i = (uint32_t)mant };
+		*out = u.f;
+	}
+	else {
+		union {
+			uint64_t i;
+			double d;
+		} u = { .i = mant };
+		*out = u.d;
+	}
+
+	return 0;
+}
+
+
+/* Correctly rounded w * 10^q without long double arithmetic, returns -1 if the slow path is needed */
+static int floatparse_decimal(uint64_t w, bool truncated, int64_t q, uint8_t type, long double *out)
+{
+	long double upper;
+
+	if (floatparse_eiselLemire(w, q, type, out) < 0) {
+		return -1;
+	}
+
+	/* Digits were dropped, the result has to be the same for both bounds of the significand */
+	if (truncated && ((floatparse_eiselLemire(w + 1, q, type, &upper) < 0) || (upper != *out))) {
+		return -1;
+	}
+
+	return 0;
+}
+
+
 /* Parse through the number and exponent */
 static const char *floatparse_number(const char *str, bool hex, uint8_t type, char decimal_point, long double *out)
 {
@@ -379,15 +621,16 @@ static const char *floatparse_number(const char *str, bool hex, uint8_t type, ch
 
 
 	size_t overflow_int = 0, frac_position = 0;
-	long double result;
+	long double result, fast;
 	int64_t total_exp = 0; /* base 2 exponent if hex, base 10 exponent otherwise */
+	uint64_t digits = 0;
+	bool truncated = false;
 
 	if (type <= TYPE_ID_DBL) {
 		/* If parsing singles/doubles it's sufficient to use uint64_t to store
 		   the digits - this allows us to use integer multiplication */
 		const uint64_t limit = hex ? (UINT64_MAX / 16) : (10000000000000000000ull / 10);
-		uint64_t digits;
-		str = scan_number(str, hex, decimal_point, limit, &frac_position, &overflow_int, &digits);
+		str = scan_number(str, hex, decimal_point, limit, &frac_position, &overflow_int, &truncated, &digits);
 		result = (long double)digits;
 	}
 	else {
@@ -418,8 +661,9 @@ static const char *floatparse_number(const char *str, bool hex, uint8_t type, ch
 
 		if (isdigit(*str_exp)) {
 			size_t exp_overflowed = 0, dummy;
+			bool exp_truncated;
 			uint64_t exp_scan;
-			str = scan_number(str_exp, 0, 0, ((INT32_MAX - 9) / 10), &dummy, &exp_overflowed, &exp_scan);
+			str = scan_number(str_exp, 0, 0, ((INT32_MAX - 9) / 10), &dummy, &exp_overflowed, &exp_truncated, &exp_scan);
 			if (exp_overflowed != 0) {
 				total_exp = exp_negative ? INT32_MIN : INT32_MAX;
 			}
@@ -431,7 +675,10 @@ static const char *floatparse_number(const char *str, bool hex, uint8_t type, ch
 	}
 
 	if (result != 0.0l) {
-		if (total_exp < exp_min) {
+		if (!hex && (type <= TYPE_ID_DBL) && (floatparse_decimal(digits, truncated, total_exp, type, &fast) == 0)) {
+			result = fast;
+		}
+		else if (total_exp < exp_min) {
 			result = 0;
 		}
 		else if (total_exp > exp_max) {
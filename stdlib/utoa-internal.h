@@ -0,0 +1,41 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Internal decimal conversion
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#ifndef _LIBPHOENIX_INTERNAL_UTOA_H_
+#define _LIBPHOENIX_INTERNAL_UTOA_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Maximum number of decimal digits of a 64-bit value */
+#define UTOA_DEC64_MAX 20
+
+
+/* Store decimal digits of num right before end, return pointer to the most significant one */
+extern char *__utoa_dec32(uint32_t num, char *end);
+
+
+extern char *__utoa_dec64(uint64_t num, char *end);
+
+
+/* Stores NUL-terminated decimal representation of value in buf (11 bytes for lib_utoa, 21 for lib_ulltoa), returns number of digits */
+extern size_t lib_utoa(unsigned int value, char *buf);
+
+
+extern size_t lib_ulltoa(unsigned long long value, char *buf);
+
+
+#endif
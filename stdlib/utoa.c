@@ -0,0 +1,136 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * stdlib/utoa.c
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <string.h>
+
+#include "utoa-internal.h"
+
+
+static const char utoa_pairs[200] = {
+	'0', '0', '0', '1', '0', '2', '0', '3', '0', '4', '0', '5', '0', '6', '0', '7', '0', '8', '0', '9',
+	'1', '0', '1', '1', '1', '2', '1', '3', '1', '4', '1', '5', '1', '6', '1', '7', '1', '8', '1', '9',
+	'2', '0', '2', '1', '2', '2', '2', '3', '2', '4', '2', '5', '2', '6', '2', '7', '2', '8', '2', '9',
+	'3', '0', '3', '1', '3', '2', '3', '3', '3', '4', '3', '5', '3', '6', '3', '7', '3', '8', '3', '9',
+	'4', '0', '4', '1', '4', '2', '4', '3', '4', '4', '4', '5', '4', '6', '4', '7', '4', '8', '4', '9',
+	'5', '0', '5', '1', '5', '2', '5', '3', '5', '4', '5', '5', '5', '6', '5', '7', '5', '8', '5', '9',
+	'6', '0', '6', '1', '6', '2', '6', '3', '6', '4', '6', '5', '6', '6', '6', '7', '6', '8', '6', '9',
+	'7', '0', '7', '1', '7', '2', '7', '3', '7', '4', '7', '5', '7', '6', '7', '7', '7', '8', '7', '9',
+	'8', '0', '8', '1', '8', '2', '8', '3', '8', '4', '8', '5', '8', '6', '8', '7', '8', '8', '8', '9',
+	'9', '0', '9', '1', '9', '2', '9', '3', '9', '4', '9', '5', '9', '6', '9', '7', '9', '8', '9', '9'
+};
+
+
+/* x / 100 for x < 43699 with a 32-bit multiplication */
+static inline uint32_t utoa_div100(uint32_t x)
+{
+	return (x * 5243) >> 19;
+}
+
+
+static inline char *utoa_put2(uint32_t x, char *end)
+{
+	end -= 2;
+	end[0] = utoa_pairs[2 * x];
+	end[1] = utoa_pairs[2 * x + 1];
+
+	return end;
+}
+
+
+/* Stores exactly 4 digits of x < 10000 */
+static inline char *utoa_put4(uint32_t x, char *end)
+{
+	uint32_t hi = utoa_div100(x);
+
+	end = utoa_put2(x - hi * 100, end);
+	return utoa_put2(hi, end);
+}
+
+
+/* Divides num by 10000 in 16-bit steps, which avoids a 64-bit division call on 32-bit targets */
+static inline uint32_t utoa_div10k(uint64_t *num)
+{
+	uint32_t hi = (uint32_t)(*num >> 32), lo = (uint32_t)*num;
+	uint32_t qhi, qmid, qlo, t;
+
+	qhi = hi / 10000;
+	t = ((hi - qhi * 10000) << 16) | (lo >> 16);
+	qmid = t / 10000;
+	t = ((t - qmid * 10000) << 16) | (lo & 0xffff);
+	qlo = t / 10000;
+
+	*num = ((uint64_t)qhi << 32) | (qmid << 16) | qlo;
+
+	return t - qlo * 10000;
+}
+
+
+char *__utoa_dec32(uint32_t num, char *end)
+{
+	uint32_t q;
+
+	while (num >= 10000) {
+		q = num / 10000;
+		end = utoa_put4(num - q * 10000, end);
+		num = q;
+	}
+
+	if (num >= 100) {
+		q = utoa_div100(num);
+		end = utoa_put2(num - q * 100, end);
+		num = q;
+	}
+
+	if (num >= 10)
+		return utoa_put2(num, end);
+
+	*--end = '0' + num;
+
+	return end;
+}
+
+
+char *__utoa_dec64(uint64_t num, char *end)
+{
+	while ((num >> 32) != 0)
+		end = utoa_put4(utoa_div10k(&num), end);
+
+	return __utoa_dec32((uint32_t)num, end);
+}
+
+
+size_t lib_utoa(unsigned int value, char *buf)
+{
+	char tmp[UTOA_DEC64_MAX];
+	char *p = __utoa_dec32(value, tmp + sizeof(tmp));
+	size_t len = tmp + sizeof(tmp) - p;
+
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+
+	return len;
+}
+
+
+size_t lib_ulltoa(unsigned long long value, char *buf)
+{
+	char tmp[UTOA_DEC64_MAX];
+	char *p = __utoa_dec64(value, tmp + sizeof(tmp));
+	size_t len = tmp + sizeof(tmp) - p;
+
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+
+	return len;
+}
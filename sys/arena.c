@@ -0,0 +1,144 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Region allocator
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <sys/arena.h>
+#include <arch.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct _arena_block_t {
+	struct _arena_block_t *next; /* Older block */
+	size_t size;
+	char data[] __attribute__((aligned(8)));
+} arena_block_t;
+
+
+#define ARENA_BLOCK_SIZE (_PAGE_SIZE - sizeof(arena_block_t))
+
+
+static void arena_setBuffer(arena_t *arena)
+{
+	uintptr_t start = ((uintptr_t) arena->buf + 7) & ~(uintptr_t) 7;
+	uintptr_t end = ((uintptr_t) arena->buf + arena->bufsz) & ~(uintptr_t) 7;
+
+	arena->block = NULL;
+	arena->ptr = NULL;
+	arena->end = NULL;
+
+	if ((arena->buf != NULL) && (start < end)) {
+		arena->ptr = (char *) start;
+		arena->end = (char *) end;
+	}
+}
+
+
+void lib_arenaInit(arena_t *arena, void *buf, size_t bufsz)
+{
+	arena->buf = buf;
+	arena->bufsz = bufsz;
+	arena_setBuffer(arena);
+}
+
+
+void *_lib_arenaGrow(arena_t *arena, size_t size)
+{
+	arena_block_t *block;
+	size_t blocksz = ARENA_BLOCK_SIZE;
+
+	if (size > SIZE_MAX - sizeof(arena_block_t) - 7) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	size = (size == 0) ? 8 : ((size + 7) & ~(size_t)7);
+	if (size > blocksz)
+		blocksz = size;
+
+	if ((block = malloc(sizeof(arena_block_t) + blocksz)) == NULL)
+		return NULL;
+
+	block->size = blocksz;
+	block->next = arena->block;
+	arena->block = block;
+	arena->ptr = block->data + size;
+	arena->end = block->data + blocksz;
+
+	return block->data;
+}
+
+
+char *lib_arenaStrdup(arena_t *arena, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *copy;
+
+	if ((copy = lib_arenaAlloc(arena, len)) != NULL)
+		memcpy(copy, s, len);
+
+	return copy;
+}
+
+
+void lib_arenaRewind(arena_t *arena, const arena_mark_t *mark)
+{
+	arena_block_t *block;
+
+	while (arena->block != mark->block) {
+		block = arena->block;
+		arena->block = block->next;
+		free(block);
+	}
+
+	arena->ptr = mark->ptr;
+	arena->end = mark->end;
+}
+
+
+void lib_arenaReset(arena_t *arena)
+{
+	arena_block_t *block = arena->block;
+
+	/* Initial buffer replaces the kept block */
+	if (arena->buf != NULL) {
+		lib_arenaDestroy(arena);
+		return;
+	}
+
+	if (block == NULL)
+		return;
+
+	while (block->next != NULL) {
+		arena->block = block->next;
+		free(block);
+		block = arena->block;
+	}
+
+	arena->ptr = block->data;
+	arena->end = block->data + block->size;
+}
+
+
+void lib_arenaDestroy(arena_t *arena)
+{
+	arena_block_t *block;
+
+	while ((block = arena->block) != NULL) {
+		arena->block = block->next;
+		free(block);
+	}
+
+	arena_setBuffer(arena);
+}
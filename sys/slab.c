@@ -0,0 +1,304 @@
+/*
+ * Phoenix-RTOS
+ *
+ * libphoenix
+ *
+ * Object cache
+ *
+ * Copyright 2026 Phoenix Systems
+ *
+ * This file is part of Phoenix-RTOS.
+ *
+ * %LICENSE%
+ */
+
+#include <sys/slab.h>
+#include <sys/threads.h>
+#include <arch.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/* Bytes of objects per slab */
+#ifndef SLAB_SIZE
+#define SLAB_SIZE          512
+#endif
+
+#define SLAB_MAGAZINES     4
+#define SLAB_MAGAZINE_SIZE 8
+
+/* Magazine count of an exiting thread, its objects go straight to the caches */
+#define SLAB_MAGAZINE_CLOSED ((unsigned int)-1)
+
+
+typedef struct _slab_t {
+	struct _slab_t *next;
+	char data[] __attribute__((aligned(8)));
+} slab_t;
+
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+
+typedef struct {
+	unsigned int count;
+	void *objs[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+
+static __thread slab_magazine_t slab_magazines[SLAB_MAGAZINES];
+
+
+static struct {
+	slabcache_t *caches[SLAB_MAGAZINES];
+	atomic_uint nmagazines;
+} slab_common;
+
+#endif
+
+
+/* Free list link is placed behind constructed objects, so that their state is kept */
+static inline void **slab_link(slabcache_t *cache, void *obj)
+{
+	return (cache->ctor != NULL) ? (void **)((char *)obj + cache->size - sizeof(void *)) : (void **)obj;
+}
+
+
+static int _slab_grow(slabcache_t *cache)
+{
+	slab_t *slab;
+
+	if ((slab = malloc(sizeof(slab_t) + cache->nslab * cache->size)) == NULL)
+		return -ENOMEM;
+
+	slab->next = cache->slabs;
+	cache->slabs = slab;
+	cache->fresh = slab->data;
+	cache->freshEnd = slab->data + cache->nslab * cache->size;
+
+	return 0;
+}
+
+
+static void *_slab_get(slabcache_t *cache)
+{
+	void *obj;
+	int err;
+
+	if ((obj = cache->free) != NULL) {
+		cache->free = *slab_link(cache, obj);
+	}
+	else {
+		if ((cache->fresh == cache->freshEnd) && ((err = _slab_grow(cache)) < 0)) {
+			errno = -err;
+			return NULL;
+		}
+
+		obj = cache->fresh;
+		if ((cache->ctor != NULL) && ((err = cache->ctor(obj)) < 0)) {
+			errno = -err;
+			return NULL;
+		}
+		cache->fresh += cache->size;
+	}
+
+	cache->nused++;
+
+	return obj;
+}
+
+
+static void _slab_put(slabcache_t *cache, void *obj)
+{
+	*slab_link(cache, obj) = cache->free;
+	cache->free = obj;
+	cache->nused--;
+}
+
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+
+static void slab_magazineFlush(slabcache_t *cache, slab_magazine_t *mag, unsigned int n)
+{
+	mutexLock(cache->lock);
+	while (n-- > 0)
+		_slab_put(cache, mag->objs[--mag->count]);
+	mutexUnlock(cache->lock);
+}
+
+
+static void slab_magazineFill(slabcache_t *cache, slab_magazine_t *mag)
+{
+	void *obj;
+
+	mutexLock(cache->lock);
+	while ((mag->count < SLAB_MAGAZINE_SIZE / 2) && ((obj = _slab_get(cache)) != NULL))
+		mag->objs[mag->count++] = obj;
+	mutexUnlock(cache->lock);
+}
+
+
+void _slab_threadCleanup(void)
+{
+	unsigned int idx, n = atomic_load(&slab_common.nmagazines);
+	slabcache_t *cache;
+
+	for (idx = 0; idx < SLAB_MAGAZINES; ++idx) {
+		if ((idx < n) && ((cache = slab_common.caches[idx]) != NULL) && (slab_magazines[idx].count != 0))
+			slab_magazineFlush(cache, &slab_magazines[idx], slab_magazines[idx].count);
+
+		slab_magazines[idx].count = SLAB_MAGAZINE_CLOSED;
+	}
+}
+
+#else
+
+void _slab_threadCleanup(void)
+{
+}
+
+#endif
+
+
+int lib_slabInit(slabcache_t *cache, size_t size, int (*ctor)(void *), void (*dtor)(void *), unsigned int flags)
+{
+	int err;
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	unsigned int idx;
+#endif
+
+	if ((size == 0) || (size > SIZE_MAX / 2))
+		return -EINVAL;
+
+	if ((err = mutexCreate(&cache->lock)) < 0)
+		return err;
+
+	size = (size + 7) & ~(size_t)7;
+	if (ctor != NULL)
+		size += 8;
+
+	cache->size = size;
+	cache->nslab = (size < SLAB_SIZE) ? SLAB_SIZE / size : 1;
+	cache->ctor = ctor;
+	cache->dtor = dtor;
+	cache->slabs = NULL;
+	cache->free = NULL;
+	cache->fresh = NULL;
+	cache->freshEnd = NULL;
+	cache->nused = 0;
+	cache->magazine = -1;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	/* Magazine slots are never reused, slots of destroyed caches stay empty */
+	if (flags & SLAB_MAGAZINE) {
+		idx = atomic_load(&slab_common.nmagazines);
+		while (idx < SLAB_MAGAZINES) {
+			if (atomic_compare_exchange_weak(&slab_common.nmagazines, &idx, idx + 1)) {
+				slab_common.caches[idx] = cache;
+				cache->magazine = idx;
+				break;
+			}
+		}
+	}
+#endif
+
+	return 0;
+}
+
+
+void *lib_slabAlloc(slabcache_t *cache)
+{
+	void *obj;
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	slab_magazine_t *mag;
+
+	if ((cache->magazine >= 0) && (slab_magazines[cache->magazine].count != SLAB_MAGAZINE_CLOSED)) {
+		mag = &slab_magazines[cache->magazine];
+		if (mag->count == 0)
+			slab_magazineFill(cache, mag);
+
+		return (mag->count != 0) ? mag->objs[--mag->count] : NULL;
+	}
+#endif
+
+	mutexLock(cache->lock);
+	obj = _slab_get(cache);
+	mutexUnlock(cache->lock);
+
+	return obj;
+}
+
+
+void lib_slabFree(slabcache_t *cache, void *obj)
+{
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	slab_magazine_t *mag;
+#endif
+
+	if (obj == NULL)
+		return;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	if ((cache->magazine >= 0) && (slab_magazines[cache->magazine].count != SLAB_MAGAZINE_CLOSED)) {
+		mag = &slab_magazines[cache->magazine];
+		if (mag->count == SLAB_MAGAZINE_SIZE)
+			slab_magazineFlush(cache, mag, SLAB_MAGAZINE_SIZE / 2);
+
+		mag->objs[mag->count++] = obj;
+		return;
+	}
+#endif
+
+	mutexLock(cache->lock);
+	_slab_put(cache, obj);
+	mutexUnlock(cache->lock);
+}
+
+
+int lib_slabDestroy(slabcache_t *cache)
+{
+	slab_t *slab;
+	void *obj, *next;
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	if ((cache->magazine >= 0) && (slab_magazines[cache->magazine].count != 0) &&
+			(slab_magazines[cache->magazine].count != SLAB_MAGAZINE_CLOSED))
+		slab_magazineFlush(cache, &slab_magazines[cache->magazine], slab_magazines[cache->magazine].count);
+#endif
+
+	mutexLock(cache->lock);
+	if (cache->nused != 0) {
+		mutexUnlock(cache->lock);
+		return -EBUSY;
+	}
+
+	if (cache->dtor != NULL) {
+		for (obj = cache->free; obj != NULL; obj = next) {
+			next = *slab_link(cache, obj);
+			cache->dtor(obj);
+		}
+	}
+
+	while ((slab = cache->slabs) != NULL) {
+		cache->slabs = slab->next;
+		free(slab);
+	}
+
+	cache->free = NULL;
+	cache->fresh = NULL;
+	cache->freshEnd = NULL;
+	mutexUnlock(cache->lock);
+
+#ifdef __LIBPHOENIX_ARCH_TLS_SUPPORTED
+	/* Other threads' magazines of this cache are empty, otherwise objects would be in use */
+	if (cache->magazine >= 0) {
+		slab_common.caches[cache->magazine] = NULL;
+		cache->magazine = -1;
+	}
+#endif
+
+	resourceDestroy(cache->lock);
+
+	return 0;
+}
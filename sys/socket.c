@@ -13,6 +13,7 @@
  * %LICENSE%
  */
 
+#include <sys/arena.h>
 #include <sys/sockport.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -320,6 +321,8 @@ int getaddrinfo(const char *node, const char *service,
 	sockport_msg_t *smi = (void *)msg.i.raw;
 	sockport_resp_t *smo = (void *)msg.o.raw;
 	size_t nodesz, servsz, bufsz;
+	char ibuf[128];
+	arena_t arena;
 	char *p;
 
 	if (hints && (hints->ai_addrlen || hints->ai_canonname || hints->ai_next))
@@ -335,10 +338,13 @@ int getaddrinfo(const char *node, const char *service,
 	smi->socket.flags = hints ? hints->ai_flags : (AI_V4MAPPED | AI_ADDRCONFIG);
 	smi->socket.ai_node_sz = nodesz;
 
+	/* Request data usually fits the stack buffer */
+	lib_arenaInit(&arena, ibuf, sizeof(ibuf));
+
 	void *idata = NULL;
 	if (nodesz + servsz) {
 		msg.i.size = nodesz + servsz;
-		idata = malloc(msg.i.size);
+		idata = lib_arenaAlloc(&arena, msg.i.size);
 		if (idata == NULL) {
 			return EAI_MEMORY;
 		}
@@ -351,14 +357,14 @@ int getaddrinfo(const char *node, const char *service,
 	for (;;) {
 		void *buf = realloc(msg.o.data, msg.o.size);
 		if (!buf) {
-			free(idata);
+			lib_arenaDestroy(&arena);
 			free(msg.o.data);
 			return EAI_MEMORY;
 		}
 		msg.o.data = buf;
 
 		if (socksrvcall(&msg) < 0) {
-			free(idata);
+			lib_arenaDestroy(&arena);
 			free(msg.o.data);
 			return EAI_SYSTEM;
 		}
@@ -372,7 +378,7 @@ int getaddrinfo(const char *node, const char *service,
 			msg.o.size *= 2;
 	}
 
-	free(idata);
+	lib_arenaDestroy(&arena);
 
 	bufsz = smo->sys.buflen;
 	if (smo->ret || bufsz > msg.o.size) {
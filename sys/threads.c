@@ -17,6 +17,15 @@
 #include <errno.h>
 
 
+extern void sys_endthread(void) __attribute__((noreturn));
+
+
+extern void _malloc_threadCleanup(void);
+
+
+extern void _slab_threadCleanup(void);
+
+
 int mutexCreate(handle_t *h)
 {
 	static const struct lockAttr defaultAttr = { .type = PH_LOCK_NORMAL };
@@ -79,3 +88,13 @@ int mutexLock2(handle_t m1, handle_t m2)
 
 	return EOK;
 }
+
+
+/* Threads started with beginthread() hand their cached chunks and slab objects back before exiting */
+void endthread(void)
+{
+	_slab_threadCleanup();
+	_malloc_threadCleanup();
+
+	sys_endthread();
+}
@@ -25,12 +25,14 @@
 #include <sys/msg.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/slab.h>
 #include <posix/utils.h>
 #include <fcntl.h>
 
 
 static struct {
 	char *cwd;
+	slabcache_t cache;
 } dir_common;
 
 static ssize_t _readlink_abs(const char *path, char *buf, size_t bufsiz);
@@ -398,17 +400,19 @@ struct dirent *readdir(DIR *dirp)
 DIR *opendir(const char *dirname)
 {
 	char *canonical_name = resolve_path(dirname, NULL, 1, 0);
-	DIR *dirp = calloc(1, sizeof(DIR));
+	DIR *dirp = lib_slabAlloc(&dir_common.cache);
 
 	if ((canonical_name == NULL) || (dirp == NULL)) {
 		free(canonical_name);
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		return NULL; /* errno set by resolve_path */
 	}
 
+	memset(dirp, 0, sizeof(*dirp));
+
 	if (!dirname[0] || (safe_lookup(canonical_name, NULL, &dirp->oid) < 0)) {
 		free(canonical_name);
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		errno = ENOENT;
 		return NULL;
 	}
@@ -425,13 +429,13 @@ DIR *opendir(const char *dirname)
 	};
 
 	if ((msgSend(dirp->oid.port, &msg) < 0) || (msg.o.err < 0)) {
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		errno = EIO;
 		return NULL;
 	}
 
 	if (msg.o.attr.val != otDir) {
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		errno = ENOTDIR;
 		return NULL;
 	}
@@ -442,7 +446,7 @@ DIR *opendir(const char *dirname)
 	msg.i.openclose.flags = 0;
 
 	if (msgSend(dirp->oid.port, &msg) < 0 || (msg.o.err < 0)) {
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		errno = EIO;
 		return NULL;
 	}
@@ -485,10 +489,11 @@ DIR *fdopendir(int fd)
 		return NULL;
 	}
 
-	dirp = calloc(1, sizeof(DIR));
+	dirp = lib_slabAlloc(&dir_common.cache);
 	if (dirp == NULL) {
-		return NULL; /* errno set by calloc() */
+		return NULL; /* errno set by lib_slabAlloc() */
 	}
+	memset(dirp, 0, sizeof(*dirp));
 	dirp->oid.port = statbuf.st_dev;
 	dirp->oid.id = statbuf.st_ino;
 	dirp->fd = fd;
@@ -496,7 +501,7 @@ DIR *fdopendir(int fd)
 	dirp->pos = pos;
 
 	if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
-		free(dirp);
+		lib_slabFree(&dir_common.cache, dirp);
 		return NULL; /* errno set by fcntl() */
 	}
 
@@ -561,12 +566,18 @@ int closedir(DIR *dirp)
 	}
 
 	free(dirp->dirent);
-	free(dirp);
+	lib_slabFree(&dir_common.cache, dirp);
 
 	return ret;
 }
 
 
+void _dir_init(void)
+{
+	lib_slabInit(&dir_common.cache, sizeof(DIR), NULL, NULL, 0);
+}
+
+
 /* readlink without path resolution, to be used internally */
 /* WARN: POSIX compliance: does not append '\0' */
 static ssize_t _readlink_abs(const char *path, char *buf, size_t bufsiz)